@@ -2,166 +2,4356 @@
 #include <vector>
 #include <fstream>
 #include <sstream>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
 #include <memory>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cmath>
+#include <map>
+#include <iomanip>
+#include <string_view>
+#include <charconv>
+#include <iterator>
+#include <limits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SHAPES_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SHAPES_TARGET_AVX2
+#else
+#define SHAPES_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Calling convention of the OpenGL entry points the instanced renderer looks up at run time
+#ifdef _WIN32
+#define SHAPES_GL_API __stdcall
+#else
+#define SHAPES_GL_API
+#endif
 
 #include <SFML/Graphics.hpp>
 #include "imgui.h"
 #include "imgui-SFML.h"
 
-// Classes for shapes
-class Shape {
-public:
-	std::string name;
-	float posX, posY;
-	float speedX, speedY;
-	float r, g, b;
-	bool shapeDrawn = true;
+// Kind tag stored alongside every shape, replaces the Circle/Rectangle class hierarchy
+enum class ShapeKind : std::uint8_t {
+	Circle,
+	Rectangle
+};
+
+// Structure-of-arrays store for all shapes. Every field lives in its own contiguous array
+// and index i refers to the same shape in each of them, so the per-frame loops walk memory linearly
+struct ShapeStore {
+	std::vector<ShapeKind> kinds;
+	std::vector<float> posX, posY;
+	std::vector<float> speedX, speedY;
+	std::vector<float> r, g, b;
+	std::vector<float> width, height;		// Bounding box extents, circles store their diameter in both
+	std::vector<float> segments;			// Circles only
+	std::vector<std::uint8_t> drawn;		// Not std::vector<bool> so elements stay addressable
+
+	// Names are packed into one buffer instead of a std::string per shape, each followed by '\0' so
+	// it can be handed to ImGui directly. Shape i's name starts at nameOffsets[i]
+	std::vector<char> nameChars;
+	std::vector<std::size_t> nameOffsets;
+
+	// Set when anything other than the kinematics changes, so the renderer only refreshes those shapes
+	std::vector<std::uint8_t> dirty;
+	bool hasDirty = false;
+
+	// Indices of each kind in insertion order, so passes that depend on the kind branch once per batch
+	std::vector<std::uint32_t> circles, rectangles;
+
+	std::size_t size() const {
+		return kinds.size();
+	}
+
+	void reserve(std::size_t count) {
+		kinds.reserve(count);
+		nameOffsets.reserve(count);
+		posX.reserve(count); posY.reserve(count);
+		speedX.reserve(count); speedY.reserve(count);
+		r.reserve(count); g.reserve(count); b.reserve(count);
+		width.reserve(count); height.reserve(count);
+		segments.reserve(count);
+		drawn.reserve(count);
+		dirty.reserve(count);
+	}
+
+	// Lengths of every array, used to lay out stores that are merged into one
+	struct Extent {
+		std::size_t shapes = 0;
+		std::size_t nameChars = 0;
+		std::size_t circles = 0;
+		std::size_t rectangles = 0;
+	};
+
+	Extent extent() const {
+		return { size(), nameChars.size(), circles.size(), rectangles.size() };
+	}
+
+	// Sets every array to the given length, the new slots are then filled in by copyInto
+	void resize(const Extent& e) {
+		kinds.resize(e.shapes);
+		nameOffsets.resize(e.shapes);
+		nameChars.resize(e.nameChars);
+		posX.resize(e.shapes); posY.resize(e.shapes);
+		speedX.resize(e.shapes); speedY.resize(e.shapes);
+		r.resize(e.shapes); g.resize(e.shapes); b.resize(e.shapes);
+		width.resize(e.shapes); height.resize(e.shapes);
+		segments.resize(e.shapes);
+		drawn.resize(e.shapes);
+		dirty.resize(e.shapes);
+		circles.resize(e.circles);
+		rectangles.resize(e.rectangles);
+	}
+
+	// Appends every shape of part after the shapes already stored
+	void append(const ShapeStore& part) {
+		const Extent at = extent();
+		const Extent added = part.extent();
+		resize({ at.shapes + added.shapes, at.nameChars + added.nameChars, at.circles + added.circles, at.rectangles + added.rectangles });
+		part.copyInto(*this, at);
+		hasDirty = hasDirty || part.hasDirty;
+	}
+
+	// Copies every shape into target, starting at the offsets in at. Different stores can be copied into
+	// disjoint parts of the same target in parallel, so hasDirty is left for the caller to update
+	void copyInto(ShapeStore& target, const Extent& at) const {
+		std::copy(kinds.begin(), kinds.end(), target.kinds.begin() + at.shapes);
+		std::copy(nameChars.begin(), nameChars.end(), target.nameChars.begin() + at.nameChars);
+		std::transform(nameOffsets.begin(), nameOffsets.end(), target.nameOffsets.begin() + at.shapes,
+			[&](std::size_t offset) { return offset + at.nameChars; });
+		std::copy(posX.begin(), posX.end(), target.posX.begin() + at.shapes);
+		std::copy(posY.begin(), posY.end(), target.posY.begin() + at.shapes);
+		std::copy(speedX.begin(), speedX.end(), target.speedX.begin() + at.shapes);
+		std::copy(speedY.begin(), speedY.end(), target.speedY.begin() + at.shapes);
+		std::copy(r.begin(), r.end(), target.r.begin() + at.shapes);
+		std::copy(g.begin(), g.end(), target.g.begin() + at.shapes);
+		std::copy(b.begin(), b.end(), target.b.begin() + at.shapes);
+		std::copy(width.begin(), width.end(), target.width.begin() + at.shapes);
+		std::copy(height.begin(), height.end(), target.height.begin() + at.shapes);
+		std::copy(segments.begin(), segments.end(), target.segments.begin() + at.shapes);
+		std::copy(drawn.begin(), drawn.end(), target.drawn.begin() + at.shapes);
+		std::copy(dirty.begin(), dirty.end(), target.dirty.begin() + at.shapes);
+
+		const std::uint32_t firstShape = static_cast<std::uint32_t>(at.shapes);
+		std::transform(circles.begin(), circles.end(), target.circles.begin() + at.circles,
+			[=](std::uint32_t index) { return index + firstShape; });
+		std::transform(rectangles.begin(), rectangles.end(), target.rectangles.begin() + at.rectangles,
+			[=](std::uint32_t index) { return index + firstShape; });
+	}
+
+	// Appends a shape with the fields common to every kind and returns its index
+	std::size_t add(ShapeKind kind, std::string_view name, float x, float y, float sx, float sy,
+		float red, float green, float blue) {
+		const std::uint32_t index = static_cast<std::uint32_t>(kinds.size());
+		(kind == ShapeKind::Circle ? circles : rectangles).push_back(index);
+
+		kinds.push_back(kind);
+		nameOffsets.push_back(nameChars.size());
+		nameChars.insert(nameChars.end(), name.begin(), name.end());
+		nameChars.push_back('\0');
+		posX.push_back(x); posY.push_back(y);
+		speedX.push_back(sx); speedY.push_back(sy);
+		r.push_back(red); g.push_back(green); b.push_back(blue);
+		width.push_back(0.0f); height.push_back(0.0f);
+		segments.push_back(64.0f);
+		drawn.push_back(1);
+		dirty.push_back(1);
+		hasDirty = true;
+		return index;
+	}
+
+	void markDirty(std::size_t i) {
+		dirty[i] = 1;
+		hasDirty = true;
+	}
+
+	void clearDirty() {
+		std::fill(dirty.begin(), dirty.end(), std::uint8_t(0));
+		hasDirty = false;
+	}
+
+	std::size_t addCircle(std::string_view name, float x, float y, float sx, float sy,
+		float red, float green, float blue, float circleRadius) {
+		std::size_t i = add(ShapeKind::Circle, name, x, y, sx, sy, red, green, blue);
+		width[i] = height[i] = circleRadius * 2;
+		return i;
+	}
+
+	std::size_t addRectangle(std::string_view name, float x, float y, float sx, float sy,
+		float red, float green, float blue, float rectangleWidth, float rectangleHeight) {
+		std::size_t i = add(ShapeKind::Rectangle, name, x, y, sx, sy, red, green, blue);
+		width[i] = rectangleWidth;
+		height[i] = rectangleHeight;
+		return i;
+	}
+
+	float radius(std::size_t i) const {
+		return width[i] * 0.5f;
+	}
+
+	const char* nameCStr(std::size_t i) const {
+		return nameChars.data() + nameOffsets[i];
+	}
+
+	std::string_view name(std::size_t i) const {
+		const std::size_t end = i + 1 < nameOffsets.size() ? nameOffsets[i + 1] : nameChars.size();
+		return std::string_view(nameChars.data() + nameOffsets[i], end - nameOffsets[i] - 1);
+	}
+
+	// Writes a line describing shape i, without flushing out
+	void print(std::size_t i, std::ostream& out) const {
+		if (kinds[i] == ShapeKind::Circle) {
+			out << "Circle created: "
+				<< name(i) << " "
+				<< posX[i] << " " << posY[i] << " "
+				<< speedX[i] << " " << speedY[i] << " "
+				<< r[i] << " " << g[i] << " " << b[i] << " "
+				<< radius(i)
+				<< '\n';
+		}
+		else {
+			out << "Rectangle created: "
+				<< name(i) << " "
+				<< posX[i] << " " << posY[i] << " "
+				<< speedX[i] << " " << speedY[i] << " "
+				<< r[i] << " " << g[i] << " " << b[i] << " "
+				<< width[i] << " " << height[i]
+				<< '\n';
+		}
+	}
+};
+
+// --------------------------------------------------------------------------
+
+// Job system used to spread per-shape work over every core. A fixed pool of workers each owns a
+// deque of jobs: the owner pops its newest job and idle workers steal the oldest job from the others
+class JobSystem {
+public:
+	explicit JobSystem(unsigned int threadCount = std::thread::hardware_concurrency()) {
+		// The thread calling parallelFor helps out, so it counts as one of the threads
+		const unsigned int workerCount = threadCount > 1 ? threadCount - 1 : 0;
+		for (unsigned int i = 0; i <= workerCount; ++i) {
+			queues.emplace_back(new WorkQueue());
+		}
+		for (unsigned int i = 0; i < workerCount; ++i) {
+			workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+		}
+	}
+
+	~JobSystem() {
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	unsigned int threadCount() const {
+		return static_cast<unsigned int>(workers.size()) + 1;
+	}
+
+	// Splits [0, count) into chunks of at least minChunk items, runs fn(begin, end) on each chunk
+	// across the pool and returns once every chunk has finished
+	template <typename Function>
+	void parallelFor(std::size_t count, std::size_t minChunk, const Function& fn) {
+		if (count == 0) {
+			return;
+		}
+
+		// A few chunks per thread gives stealing something to balance with. Chunks of more than 64 items
+		// are rounded to a multiple of 64 so neighbouring chunks never write to the same cache line of a
+		// float array, smaller ones are coarse work items such as whole file chunks and are left alone
+		const std::size_t maxChunks = static_cast<std::size_t>(threadCount()) * 4;
+		std::size_t chunkSize = std::max(minChunk, (count + maxChunks - 1) / maxChunks);
+		if (chunkSize > 64) {
+			chunkSize = (chunkSize + 63) / 64 * 64;
+		}
+		if (chunkSize >= count) {
+			fn(std::size_t(0), count);
+			return;
+		}
+
+		std::atomic<std::size_t> remaining((count + chunkSize - 1) / chunkSize);
+		for (std::size_t begin = 0; begin < count; begin += chunkSize) {
+			const std::size_t end = std::min(begin + chunkSize, count);
+			submit(Job{ [&fn, begin, end]() { fn(begin, end); }, &remaining });
+		}
+		wait(remaining);
+	}
+
+private:
+	struct Job {
+		std::function<void()> run;
+		std::atomic<std::size_t>* remaining;
+	};
+
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	void submit(Job job) {
+		const std::size_t index = nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+		{
+			// Counted before it is pushed, so a worker popping it straight away cannot take the count below
+			// zero. Taking the sleep mutex means a worker cannot miss the wake up between checking and waiting
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			++queuedJobs;
+		}
+		{
+			std::lock_guard<std::mutex> lock(queues[index]->mutex);
+			queues[index]->jobs.push_back(std::move(job));
+		}
+		wake.notify_one();
+	}
+
+	bool popOwn(std::size_t index, Job& job) {
+		WorkQueue& queue = *queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty()) {
+			return false;
+		}
+		job = std::move(queue.jobs.back());
+		queue.jobs.pop_back();
+		--queuedJobs;
+		return true;
+	}
+
+	bool steal(std::size_t thief, Job& job) {
+		for (std::size_t offset = 1; offset < queues.size(); ++offset) {
+			WorkQueue& queue = *queues[(thief + offset) % queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.jobs.empty()) {
+				job = std::move(queue.jobs.front());
+				queue.jobs.pop_front();
+				--queuedJobs;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool takeJob(std::size_t index, Job& job) {
+		return popOwn(index, job) || steal(index, job);
+	}
+
+	void runJob(Job& job) {
+		job.run();
+		if (job.remaining->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			// The last chunk, remaining may go out of scope as soon as the waiting thread sees it
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+			}
+			finished.notify_all();
+		}
+	}
+
+	void workerLoop(std::size_t index) {
+		Job job;
+		while (true) {
+			if (takeJob(index, job)) {
+				runJob(job);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait(lock, [this]() { return stopping || queuedJobs > 0; });
+			if (stopping && queuedJobs == 0) {
+				return;
+			}
+		}
+	}
+
+	// The waiting thread works through queue 0 and steals from the workers, then sleeps once every chunk
+	// has been taken until the last one finishes. The simulation and render threads can both wait at once,
+	// so finishing wakes all of them and each checks its own counter
+	void wait(const std::atomic<std::size_t>& remaining) {
+		Job job;
+		while (remaining.load(std::memory_order_acquire) > 0) {
+			if (takeJob(0, job)) {
+				runJob(job);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			finished.wait(lock, [&remaining]() { return remaining.load(std::memory_order_acquire) == 0; });
+		}
+	}
+
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<std::size_t> nextQueue{ 0 };
+	std::atomic<std::size_t> queuedJobs{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wake;		// Workers waiting for a job
+	std::condition_variable finished;	// Threads in wait waiting for their last chunk
+	bool stopping = false;
+};
+
+// --------------------------------------------------------------------------
+
+// Frame profiler. Scoped zones record when they start and end into a ring buffer that any thread can
+// write to without taking a lock, and the Debug Panel reads it back to show where frame time goes
+
+// One finished zone
+struct ProfileEvent {
+	const char* zone;				// A string literal, zones are told apart by its address
+	std::uint64_t frame;			// Frame the zone started in
+	std::int64_t start, end;		// Nanoseconds since the profiler was created
+	std::uint32_t depth;			// How many zones were open around it on the same thread
+	std::uint32_t thread;			// Small index per thread, in the order threads first recorded
+};
+
+class FrameProfiler {
+public:
+	static const std::size_t capacity = 1 << 14;	// Power of two, so indices wrap with a mask
+
+	FrameProfiler() : slots(new Slot[capacity]), epoch(std::chrono::steady_clock::now()) {}
+
+	// Called at the top of every frame of the main loop
+	void beginFrame() {
+		frame.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::uint64_t currentFrame() const {
+		return frame.load(std::memory_order_relaxed);
+	}
+
+	std::int64_t now() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	// Every slot is guarded by a sequence number that is odd while the slot is being written and
+	// 2 * (index + 1) once event number index is complete, so a reader can tell a torn or reused slot
+	void record(const ProfileEvent& event) {
+		const std::uint64_t index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+		Slot& slot = slots[index & (capacity - 1)];
+		slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.zone.store(event.zone, std::memory_order_relaxed);
+		slot.frame.store(event.frame, std::memory_order_relaxed);
+		slot.start.store(event.start, std::memory_order_relaxed);
+		slot.end.store(event.end, std::memory_order_relaxed);
+		slot.place.store(static_cast<std::uint64_t>(event.thread) << 32 | event.depth, std::memory_order_relaxed);
+		slot.sequence.store(index * 2 + 2, std::memory_order_release);
+	}
+
+	// Appends the events recorded since next to out and moves next past them. Events overwritten before
+	// they were read are skipped, reading stops at an event that is still being written
+	void read(std::uint64_t& next, std::vector<ProfileEvent>& out) const {
+		const std::uint64_t end = writeIndex.load(std::memory_order_acquire);
+		if (end - next > capacity) {
+			next = end - capacity;
+		}
+
+		for (; next < end; ++next) {
+			const Slot& slot = slots[next & (capacity - 1)];
+			const std::uint64_t complete = next * 2 + 2;
+			const std::uint64_t before = slot.sequence.load(std::memory_order_acquire);
+			if (before < complete) {
+				return;
+			}
+
+			ProfileEvent event;
+			event.zone = slot.zone.load(std::memory_order_relaxed);
+			event.frame = slot.frame.load(std::memory_order_relaxed);
+			event.start = slot.start.load(std::memory_order_relaxed);
+			event.end = slot.end.load(std::memory_order_relaxed);
+			const std::uint64_t place = slot.place.load(std::memory_order_relaxed);
+			event.depth = static_cast<std::uint32_t>(place);
+			event.thread = static_cast<std::uint32_t>(place >> 32);
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (before == complete && slot.sequence.load(std::memory_order_relaxed) == complete) {
+				out.push_back(event);
+			}
+		}
+	}
+
+	static std::uint32_t threadIndex() {
+		static std::atomic<std::uint32_t> threadCount{ 0 };
+		thread_local const std::uint32_t index = threadCount.fetch_add(1, std::memory_order_relaxed);
+		return index;
+	}
+
+	static std::uint32_t& threadDepth() {
+		thread_local std::uint32_t depth = 0;
+		return depth;
+	}
+
+private:
+	// Every field is atomic so a reader racing a writer sees a stale or new value rather than undefined behaviour
+	struct alignas(64) Slot {
+		std::atomic<std::uint64_t> sequence{ 0 };
+		std::atomic<const char*> zone{ nullptr };
+		std::atomic<std::uint64_t> frame{ 0 };
+		std::atomic<std::int64_t> start{ 0 };
+		std::atomic<std::int64_t> end{ 0 };
+		std::atomic<std::uint64_t> place{ 0 };	// Thread in the high half, depth in the low half
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	std::chrono::steady_clock::time_point epoch;
+	alignas(64) std::atomic<std::uint64_t> writeIndex{ 0 };
+	alignas(64) std::atomic<std::uint64_t> frame{ 0 };
+};
+
+// The profiler every zone records into
+FrameProfiler& Profiler() {
+	static FrameProfiler profiler;
+	return profiler;
+}
+
+// Times the enclosing scope as the given zone
+class ProfileScope {
+public:
+	explicit ProfileScope(const char* zone)
+		: zone(zone), frame(Profiler().currentFrame()), depth(FrameProfiler::threadDepth()++), start(Profiler().now()) {
+	}
+
+	~ProfileScope() {
+		--FrameProfiler::threadDepth();
+		Profiler().record({ zone, frame, start, Profiler().now(), depth, FrameProfiler::threadIndex() });
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	const char* zone;
+	std::uint64_t frame;
+	std::uint32_t depth;
+	std::int64_t start;
+};
+
+// --------------------------------------------------------------------------
+
+// Structures & class for configuration
+struct WindowConfig {
+	int width = 0;
+	int height = 0;
+};
+
+// Size of the area the shapes move in, which the window shows part or all of. 0 when the configuration
+// has no World line, in which case the world is as big as the window
+struct WorldConfig {
+	int width = 0;
+	int height = 0;
+};
+
+struct FontConfig {
+	std::string path;
+	int size = 0;
+	int r = 0, g = 0, b = 0;
+};
+
+struct Configuration {
+	WindowConfig window;
+	WorldConfig world;
+	FontConfig font;
+	ShapeStore shapes;
+};
+
+// The bounds shapes bounce off
+sf::Vector2u WorldSize(const Configuration& config) {
+	if (config.world.width > 0 && config.world.height > 0) {
+		return sf::Vector2u(static_cast<unsigned int>(config.world.width), static_cast<unsigned int>(config.world.height));
+	}
+	return sf::Vector2u(static_cast<unsigned int>(std::max(config.window.width, 0)), static_cast<unsigned int>(std::max(config.window.height, 0)));
+}
+
+// --------------------------------------------------------------------------
+
+// Read-only memory mapping of a whole file, so the loader can tokenise it in place without copying
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		LARGE_INTEGER fileSize;
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)) {
+			return;
+		}
+
+		size = static_cast<std::size_t>(fileSize.QuadPart);
+		if (size > 0) {
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			data = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+			if (!data) {
+				return;
+			}
+		}
+		open = true;
+#else
+		const int descriptor = ::open(path.c_str(), O_RDONLY);
+		struct stat status;
+		if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+			if (descriptor >= 0) {
+				close(descriptor);
+			}
+			return;
+		}
+
+		size = static_cast<std::size_t>(status.st_size);
+		if (size > 0) {
+			void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if (mapped != MAP_FAILED) {
+				madvise(mapped, size, MADV_SEQUENTIAL);
+				data = static_cast<const char*>(mapped);
+			}
+		}
+		close(descriptor); // The mapping stays valid without the descriptor
+		open = size == 0 || data != nullptr;
+#endif
+	}
+
+	~MappedFile() {
+#ifdef _WIN32
+		if (data) {
+			UnmapViewOfFile(data);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+		}
+#else
+		if (data) {
+			munmap(const_cast<char*>(data), size);
+		}
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool isOpen() const {
+		return open;
+	}
+
+	std::string_view view() const {
+		return data ? std::string_view(data, size) : std::string_view();
+	}
+
+private:
+	const char* data = nullptr;
+	std::size_t size = 0;
+	bool open = false;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+};
+
+// Splits one line of the configuration into whitespace separated fields, as views into the line.
+// Numbers are parsed with std::from_chars, which ignores the locale and never allocates. A missing
+// or malformed number reads as 0, the same as a failed operator>> extraction
+class LineTokens {
+public:
+	explicit LineTokens(std::string_view line) : rest(line) {}
+
+	std::string_view next() {
+		std::size_t start = 0;
+		while (start < rest.size() && IsSpace(rest[start])) {
+			++start;
+		}
+		std::size_t end = start;
+		while (end < rest.size() && !IsSpace(rest[end])) {
+			++end;
+		}
+
+		std::string_view token = rest.substr(start, end - start);
+		rest.remove_prefix(end);
+		return token;
+	}
+
+	template <typename Number>
+	LineTokens& operator>>(Number& value) {
+		std::string_view token = next();
+		if (!token.empty() && token[0] == '+') {
+			token.remove_prefix(1); // operator>> accepted a leading plus, from_chars does not
+		}
+
+		value = Number();
+		std::from_chars(token.data(), token.data() + token.size(), value);
+		return *this;
+	}
+
+	LineTokens& operator>>(std::string_view& value) {
+		value = next();
+		return *this;
+	}
+
+	LineTokens& operator>>(std::string& value) {
+		value = std::string(next());
+		return *this;
+	}
+
+private:
+	static bool IsSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	std::string_view rest;
+};
+
+// Which of the directives that replace a whole configuration section a piece of text contained
+struct ParsedDirectives {
+	bool window = false;
+	bool world = false;
+	bool font = false;
+};
+
+// Parses configuration text into config, one directive per line. Shapes are appended to config.shapes
+ParsedDirectives ParseConfiguration(std::string_view text, Configuration& config) {
+	ParsedDirectives directives;
+
+	// One pass counting lines is far cheaper than letting every array regrow
+	config.shapes.reserve(config.shapes.size() + std::count(text.begin(), text.end(), '\n') + 1);
+
+	while (!text.empty()) {
+		const std::size_t lineEnd = text.find('\n');
+		LineTokens iss(text.substr(0, lineEnd));
+		text.remove_prefix(lineEnd == std::string_view::npos ? text.size() : lineEnd + 1);
+
+		const std::string_view dataType = iss.next();
+
+		if (dataType == "Circle") {
+			std::string_view name;
+			float posX, posY, speedX, speedY, r, g, b, radius;
+			iss >> name >> posX >> posY >> speedX >> speedY >> r >> g >> b >> radius;
+
+			config.shapes.addCircle(name, posX, posY, speedX, speedY, r, g, b, radius);
+		}
+		else if (dataType == "Rectangle") {
+			std::string_view name;
+			float posX, posY, speedX, speedY, r, g, b, width, height;
+			iss >> name >> posX >> posY >> speedX >> speedY >> r >> g >> b >> width >> height;
+
+			config.shapes.addRectangle(name, posX, posY, speedX, speedY, r, g, b, width, height);
+		}
+		else if (dataType == "Font") {
+			iss >> config.font.path >> config.font.size >> config.font.r >> config.font.g >> config.font.b;
+			directives.font = true;
+		}
+		else if (dataType == "Window") {
+			iss >> config.window.width >> config.window.height;
+			directives.window = true;
+		}
+		else if (dataType == "World") {
+			iss >> config.world.width >> config.world.height;
+			directives.world = true;
+		}
+	}
+
+	return directives;
+}
+
+// Splits text into at most maxChunks pieces of similar size that each end on a line boundary
+std::vector<std::string_view> SplitLines(std::string_view text, std::size_t maxChunks) {
+	std::vector<std::string_view> chunks;
+	const std::size_t targetSize = text.size() / std::max<std::size_t>(maxChunks, 1) + 1;
+
+	while (!text.empty()) {
+		std::size_t end = text.size();
+		if (targetSize < text.size()) {
+			const std::size_t newline = text.find('\n', targetSize);
+			end = newline == std::string_view::npos ? text.size() : newline + 1;
+		}
+		chunks.push_back(text.substr(0, end));
+		text.remove_prefix(end);
+	}
+	return chunks;
+}
+
+// Concatenates the stores in order. Every part is copied into its own slice of the merged arrays
+// in parallel, so merging costs one pass over the data instead of repeated regrowth
+ShapeStore MergeShapeStores(const std::vector<ShapeStore>& parts, JobSystem& jobs) {
+	std::vector<ShapeStore::Extent> offsets(parts.size());
+	ShapeStore::Extent total;
+	ShapeStore merged;
+
+	for (std::size_t p = 0; p < parts.size(); ++p) {
+		offsets[p] = total;
+		const ShapeStore::Extent e = parts[p].extent();
+		total.shapes += e.shapes;
+		total.nameChars += e.nameChars;
+		total.circles += e.circles;
+		total.rectangles += e.rectangles;
+		merged.hasDirty = merged.hasDirty || parts[p].hasDirty;
+	}
+
+	merged.resize(total);
+	jobs.parallelFor(parts.size(), 1, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t p = begin; p < end; ++p) {
+			parts[p].copyInto(merged, offsets[p]);
+		}
+	});
+	return merged;
+}
+
+// Compiled scene files, a binary copy of a Configuration made with --compile-scene. The header holds the
+// Window, World and Font sections and a table of sections, one per ShapeStore array plus the font path. Every
+// section starts on a 64 byte boundary and is stored exactly as the array is laid out in memory, so
+// loading maps the file and copies each array in one go with no parsing and no per-shape work
+const char sceneMagic[8] = { 'S', 'H', 'P', 'S', 'C', 'E', 'N', 'E' };
+const std::uint32_t sceneVersion = 2;
+const std::uint32_t sceneEndianMarker = 0x01020304;	// Reads back differently on a machine of the other endianness
+const std::uint64_t sceneAlignment = 64;
+
+enum SceneSection : std::uint32_t {
+	SceneKinds,
+	SceneNameOffsets,	// Stored as 64 bit offsets whatever the size of std::size_t
+	SceneNameChars,
+	ScenePosX,
+	ScenePosY,
+	SceneSpeedX,
+	SceneSpeedY,
+	SceneRed,
+	SceneGreen,
+	SceneBlue,
+	SceneWidth,
+	SceneHeight,
+	SceneSegments,
+	SceneDrawn,
+	SceneCircles,
+	SceneRectangles,
+	SceneFontPath,
+	SceneSectionCount
+};
+
+struct SceneSectionEntry {
+	std::uint64_t offset;
+	std::uint64_t bytes;
+};
+
+struct SceneHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t endianMarker;
+	std::int32_t windowWidth, windowHeight;
+	std::int32_t worldWidth, worldHeight;
+	std::int32_t fontSize, fontR, fontG, fontB;
+	std::uint64_t shapeCount;
+	SceneSectionEntry sections[SceneSectionCount];
+};
+
+bool IsCompiledScene(std::string_view data) {
+	return data.size() >= sizeof(sceneMagic) && std::memcmp(data.data(), sceneMagic, sizeof(sceneMagic)) == 0;
+}
+
+// Writes config as a compiled scene, returns false if the file could not be written
+bool CompileScene(const Configuration& config, const std::string& scenePath) {
+	const ShapeStore& shapes = config.shapes;
+	const std::vector<std::uint64_t> nameOffsets(shapes.nameOffsets.begin(), shapes.nameOffsets.end());
+
+	// Where each section's bytes come from, in SceneSection order
+	const std::pair<const void*, std::size_t> sources[SceneSectionCount] = {
+		{ shapes.kinds.data(), shapes.kinds.size() * sizeof(ShapeKind) },
+		{ nameOffsets.data(), nameOffsets.size() * sizeof(std::uint64_t) },
+		{ shapes.nameChars.data(), shapes.nameChars.size() },
+		{ shapes.posX.data(), shapes.posX.size() * sizeof(float) },
+		{ shapes.posY.data(), shapes.posY.size() * sizeof(float) },
+		{ shapes.speedX.data(), shapes.speedX.size() * sizeof(float) },
+		{ shapes.speedY.data(), shapes.speedY.size() * sizeof(float) },
+		{ shapes.r.data(), shapes.r.size() * sizeof(float) },
+		{ shapes.g.data(), shapes.g.size() * sizeof(float) },
+		{ shapes.b.data(), shapes.b.size() * sizeof(float) },
+		{ shapes.width.data(), shapes.width.size() * sizeof(float) },
+		{ shapes.height.data(), shapes.height.size() * sizeof(float) },
+		{ shapes.segments.data(), shapes.segments.size() * sizeof(float) },
+		{ shapes.drawn.data(), shapes.drawn.size() },
+		{ shapes.circles.data(), shapes.circles.size() * sizeof(std::uint32_t) },
+		{ shapes.rectangles.data(), shapes.rectangles.size() * sizeof(std::uint32_t) },
+		{ config.font.path.data(), config.font.path.size() },
+	};
+
+	SceneHeader header = {};
+	std::memcpy(header.magic, sceneMagic, sizeof(sceneMagic));
+	header.version = sceneVersion;
+	header.endianMarker = sceneEndianMarker;
+	header.windowWidth = config.window.width;
+	header.windowHeight = config.window.height;
+	header.worldWidth = config.world.width;
+	header.worldHeight = config.world.height;
+	header.fontSize = config.font.size;
+	header.fontR = config.font.r;
+	header.fontG = config.font.g;
+	header.fontB = config.font.b;
+	header.shapeCount = shapes.size();
+
+	std::uint64_t offset = sizeof(SceneHeader);
+	for (std::uint32_t section = 0; section < SceneSectionCount; ++section) {
+		offset = (offset + sceneAlignment - 1) / sceneAlignment * sceneAlignment;
+		header.sections[section] = { offset, sources[section].second };
+		offset += sources[section].second;
+	}
+
+	std::ofstream file(scenePath, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	std::uint64_t written = sizeof(header);
+	const char padding[sceneAlignment] = {};
+	for (std::uint32_t section = 0; section < SceneSectionCount; ++section) {
+		file.write(padding, static_cast<std::streamsize>(header.sections[section].offset - written));
+		file.write(static_cast<const char*>(sources[section].first), static_cast<std::streamsize>(sources[section].second));
+		written = header.sections[section].offset + sources[section].second;
+	}
+	return static_cast<bool>(file);
+}
+
+// Copies a compiled scene out of its mapping. Returns false if the header or the section table does not
+// describe a complete, consistent scene of this version
+bool LoadCompiledScene(std::string_view data, Configuration& config) {
+	SceneHeader header;
+	if (data.size() < sizeof(header)) {
+		return false;
+	}
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (header.version != sceneVersion || header.endianMarker != sceneEndianMarker) {
+		return false;
+	}
+
+	// Every section must lie inside the file and hold exactly as many elements as the header says
+	const std::uint64_t count = header.shapeCount;
+	const std::uint64_t elementSizes[SceneSectionCount] = {
+		sizeof(ShapeKind), sizeof(std::uint64_t), 1, sizeof(float), sizeof(float), sizeof(float), sizeof(float),
+		sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), 1,
+		sizeof(std::uint32_t), sizeof(std::uint32_t), 1
+	};
+	for (std::uint32_t section = 0; section < SceneSectionCount; ++section) {
+		const SceneSectionEntry& entry = header.sections[section];
+		if (entry.offset > data.size() || entry.bytes > data.size() - entry.offset || entry.bytes % elementSizes[section] != 0) {
+			return false;
+		}
+		const bool perShape = section != SceneNameChars && section != SceneCircles && section != SceneRectangles && section != SceneFontPath;
+		if (perShape && entry.bytes / elementSizes[section] != count) {
+			return false;
+		}
+	}
+	if ((header.sections[SceneCircles].bytes + header.sections[SceneRectangles].bytes) / sizeof(std::uint32_t) != count) {
+		return false;
+	}
+
+	const auto section = [&](SceneSection s) {
+		return data.data() + header.sections[s].offset;
+	};
+	const auto elements = [&](SceneSection s) {
+		return static_cast<std::size_t>(header.sections[s].bytes / elementSizes[s]);
+	};
+
+	ShapeStore& shapes = config.shapes;
+	const auto copy = [&](auto& target, SceneSection s) {
+		using Element = typename std::decay_t<decltype(target)>::value_type;
+		target.resize(elements(s));
+		std::memcpy(target.data(), section(s), elements(s) * sizeof(Element));
+	};
+	copy(shapes.kinds, SceneKinds);
+	copy(shapes.nameChars, SceneNameChars);
+	copy(shapes.posX, ScenePosX);
+	copy(shapes.posY, ScenePosY);
+	copy(shapes.speedX, SceneSpeedX);
+	copy(shapes.speedY, SceneSpeedY);
+	copy(shapes.r, SceneRed);
+	copy(shapes.g, SceneGreen);
+	copy(shapes.b, SceneBlue);
+	copy(shapes.width, SceneWidth);
+	copy(shapes.height, SceneHeight);
+	copy(shapes.segments, SceneSegments);
+	copy(shapes.drawn, SceneDrawn);
+	copy(shapes.circles, SceneCircles);
+	copy(shapes.rectangles, SceneRectangles);
+
+	// Names are only handed out as pointers into nameChars and measured up to the next offset, so the
+	// offsets have to start at 0 and rise strictly, and every name has to end with '\0' right before
+	// the next one starts
+	std::vector<std::uint64_t> nameOffsets(elements(SceneNameOffsets));
+	std::memcpy(nameOffsets.data(), section(SceneNameOffsets), nameOffsets.size() * sizeof(std::uint64_t));
+	if (!nameOffsets.empty() && (nameOffsets[0] != 0 || shapes.nameChars.empty() || shapes.nameChars.back() != '\0')) {
+		return false;
+	}
+	shapes.nameOffsets.resize(nameOffsets.size());
+	for (std::size_t i = 0; i < nameOffsets.size(); ++i) {
+		if (nameOffsets[i] >= shapes.nameChars.size()) {
+			return false;
+		}
+		if (i > 0 && (nameOffsets[i] <= nameOffsets[i - 1] || shapes.nameChars[static_cast<std::size_t>(nameOffsets[i]) - 1] != '\0')) {
+			return false;
+		}
+		shapes.nameOffsets[i] = static_cast<std::size_t>(nameOffsets[i]);
+	}
+
+	// Every kind has to be known, and the per-kind lists have to name each shape exactly once, in the
+	// list of its own kind
+	for (ShapeKind kind : shapes.kinds) {
+		if (kind != ShapeKind::Circle && kind != ShapeKind::Rectangle) {
+			return false;
+		}
+	}
+	std::vector<std::uint8_t> listed(shapes.size(), 0);
+	const auto checkList = [&](const std::vector<std::uint32_t>& list, ShapeKind kind) {
+		for (std::uint32_t index : list) {
+			if (index >= count || listed[index] || shapes.kinds[index] != kind) {
+				return false;
+			}
+			listed[index] = 1;
+		}
+		return true;
+	};
+	if (!checkList(shapes.circles, ShapeKind::Circle) || !checkList(shapes.rectangles, ShapeKind::Rectangle)) {
+		return false;
+	}
+
+	shapes.dirty.assign(shapes.size(), 1);
+	shapes.hasDirty = true;
+
+	config.window.width = header.windowWidth;
+	config.window.height = header.windowHeight;
+	config.world.width = header.worldWidth;
+	config.world.height = header.worldHeight;
+	config.font.path.assign(section(SceneFontPath), elements(SceneFontPath));
+	config.font.size = header.fontSize;
+	config.font.r = header.fontR;
+	config.font.g = header.fontG;
+	config.font.b = header.fontB;
+	return true;
+}
+
+// Files are parsed in newline-aligned chunks of at least this many bytes, one chunk per job
+const std::size_t configurationChunkBytes = 1 << 20;
+
+// Parses the chunks of the text on every thread of the job system, then merges them in file order.
+// A Window, World or Font line replaces the whole section, so the last chunk containing one decides its value
+Configuration ParseConfigurationChunks(std::string_view text, JobSystem& jobs) {
+	const std::size_t maxChunks = std::min<std::size_t>(text.size() / configurationChunkBytes + 1, jobs.threadCount() * 4);
+	const std::vector<std::string_view> chunks = SplitLines(text, maxChunks);
+
+	std::vector<Configuration> parts(chunks.size());
+	std::vector<ParsedDirectives> directives(chunks.size());
+	jobs.parallelFor(chunks.size(), 1, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t c = begin; c < end; ++c) {
+			directives[c] = ParseConfiguration(chunks[c], parts[c]);
+		}
+	});
+
+	Configuration config;
+	std::vector<ShapeStore> shapeParts(chunks.size());
+	for (std::size_t c = 0; c < chunks.size(); ++c) {
+		if (directives[c].window) {
+			config.window = parts[c].window;
+		}
+		if (directives[c].world) {
+			config.world = parts[c].world;
+		}
+		if (directives[c].font) {
+			config.font = parts[c].font;
+		}
+		shapeParts[c] = std::move(parts[c].shapes);
+	}
+	config.shapes = MergeShapeStores(shapeParts, jobs);
+
+	return config;
+}
+
+// How much is printed about a configuration once it has loaded
+enum class LoadVerbosity {
+	Quiet,		// Nothing
+	Summary,	// Shape counts per kind, size and timings
+	Shapes		// The summary and a line for every shape
+};
+
+// What a load did, collected while loading and printed in one go afterwards so the load itself never
+// waits on the terminal
+struct LoadReport {
+	std::string path;
+	std::size_t bytes = 0;
+	std::size_t batches = 1;
+	bool compiled = false;			// Loaded from a compiled scene rather than text
+	double firstBatchMs = 0.0;		// Until the first batch could be drawn, only meaningful when streaming
+	double totalMs = 0.0;
+	std::string shapeDump;			// The per-shape lines, only filled in for LoadVerbosity::Shapes
+};
+
+// Appends the lines describing shapes [first, shapes.size()) to out
+void AppendShapeDump(std::string& out, const ShapeStore& shapes, std::size_t first) {
+	std::ostringstream lines;
+	for (std::size_t i = first; i < shapes.size(); ++i) {
+		shapes.print(i, lines);
+	}
+	out += lines.str();
+}
+
+void PrintLoadReport(const LoadReport& report, const ShapeStore& shapes, LoadVerbosity verbosity) {
+	if (verbosity == LoadVerbosity::Quiet) {
+		return;
+	}
+	if (verbosity == LoadVerbosity::Shapes) {
+		std::fwrite(report.shapeDump.data(), 1, report.shapeDump.size(), stdout);
+	}
+
+	std::printf("Loaded %zu shapes (%zu circles, %zu rectangles) from %s: %.2f MB %s, %zu batch%s, %.3f ms",
+		shapes.size(), shapes.circles.size(), shapes.rectangles.size(), report.path.c_str(),
+		report.bytes / (1024.0 * 1024.0), report.compiled ? "scene" : "text",
+		report.batches, report.batches == 1 ? "" : "es", report.totalMs);
+	if (report.batches > 1) {
+		std::printf(", first batch after %.3f ms", report.firstBatchMs);
+	}
+	std::printf("\n");
+	std::fflush(stdout);
+}
+
+// Loads either a text configuration or a scene compiled from one with --compile-scene, filling in
+// report when one is given
+Configuration LoadConfiguration(const std::string& configurationPath, JobSystem& jobs, LoadReport* report = nullptr, LoadVerbosity verbosity = LoadVerbosity::Summary) {
+	const auto start = std::chrono::steady_clock::now();
+	MappedFile file(configurationPath);
+
+	if (!file.isOpen()) {
+		std::cerr << "Error: Unable to open file." << std::endl;
+		exit(-1);
+	}
+
+	Configuration config;
+	if (IsCompiledScene(file.view())) {
+		if (!LoadCompiledScene(file.view(), config)) {
+			std::cerr << "Error: Compiled scene is corrupt or from an incompatible version." << std::endl;
+			exit(-1);
+		}
+	}
+	else {
+		config = ParseConfigurationChunks(file.view(), jobs);
+	}
+
+	if (report) {
+		report->path = configurationPath;
+		report->bytes = file.view().size();
+		report->compiled = IsCompiledScene(file.view());
+		report->totalMs = report->firstBatchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (verbosity == LoadVerbosity::Shapes) {
+			AppendShapeDump(report->shapeDump, config.shapes, 0);
+		}
+	}
+
+	return config;
+}
+
+// --------------------------------------------------------------------------
+
+// Lock-free queue for exactly one producer thread and one consumer thread. Each side only ever
+// writes its own index, so a release store publishing a slot and an acquire load reading it are enough
+template <typename T>
+class SpscQueue {
+public:
+	// Capacity is rounded up to a power of two so indices wrap with a mask
+	explicit SpscQueue(std::size_t capacity) {
+		std::size_t size = 1;
+		while (size < capacity) {
+			size *= 2;
+		}
+		slots.resize(size);
+		mask = size - 1;
+	}
+
+	// Returns false without taking value when the queue is full
+	bool push(T& value) {
+		const std::size_t tailIndex = tail.load(std::memory_order_relaxed);
+		if (tailIndex - head.load(std::memory_order_acquire) == slots.size()) {
+			return false;
+		}
+		slots[tailIndex & mask] = std::move(value);
+		tail.store(tailIndex + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& value) {
+		const std::size_t headIndex = head.load(std::memory_order_relaxed);
+		if (headIndex == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = std::move(slots[headIndex & mask]);
+		head.store(headIndex + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Only meaningful on the consumer thread, where it stays false until the next pop
+	bool empty() const {
+		return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+	}
+
+private:
+	std::vector<T> slots;
+	std::size_t mask;
+	alignas(64) std::atomic<std::size_t> head{ 0 };		// Next slot to pop, written by the consumer
+	alignas(64) std::atomic<std::size_t> tail{ 0 };		// Next slot to push, written by the producer
+};
+
+// Loads a configuration on a background thread and hands it over in batches, so the window can open
+// and start drawing after the first batch instead of after the whole file
+class StreamingLoader {
+public:
+	// A batch is the shapes and directives of a run of lines of about batchBytes bytes
+	struct Batch {
+		Configuration config;
+		ParsedDirectives directives;
+	};
+
+	explicit StreamingLoader(const std::string& configurationPath, LoadVerbosity verbosity = LoadVerbosity::Summary, std::size_t batchBytes = 256 * 1024)
+		: file(configurationPath), batches(64), batchBytes(batchBytes), verbosity(verbosity), start(std::chrono::steady_clock::now()) {
+		if (!file.isOpen()) {
+			std::cerr << "Error: Unable to open file." << std::endl;
+			exit(-1);
+		}
+		loadReport.path = configurationPath;
+		loadReport.bytes = file.view().size();
+		loadReport.batches = 0;
+		producer = std::thread(&StreamingLoader::produce, this);
+	}
+
+	~StreamingLoader() {
+		stopping = true;
+		wakeUp();
+		producer.join();
+	}
+
+	StreamingLoader(const StreamingLoader&) = delete;
+	StreamingLoader& operator=(const StreamingLoader&) = delete;
+
+	// True once every batch has been parsed and taken by receive
+	bool finished() const {
+		return receivedAll;
+	}
+
+	// Only complete once finished returns true
+	const LoadReport& report() const {
+		return loadReport;
+	}
+
+	// Appends every batch that is ready to config, returns the number of batches taken
+	std::size_t receive(Configuration& config) {
+		// The producer flags completion after pushing its last batch, so once the flag is seen before
+		// draining, the queue is empty for good afterwards
+		const bool producerDone = produced.load(std::memory_order_acquire);
+
+		std::size_t count = 0;
+		std::unique_ptr<Batch> batch;
+		while (batches.pop(batch)) {
+			if (batch->directives.window) {
+				config.window = batch->config.window;
+			}
+			if (batch->directives.world) {
+				config.world = batch->config.world;
+			}
+			if (batch->directives.font) {
+				config.font = batch->config.font;
+			}
+			config.shapes.append(batch->config.shapes);
+			++count;
+		}
+		if (count != 0) {
+			// Only after draining, the producer may have filled the queue again and gone back to waiting
+			// while this loop was still popping
+			wakeUp();
+		}
+
+		receivedAll = producerDone;
+		return count;
+	}
+
+	// Blocks until at least one batch has arrived or the whole file turned out to be empty
+	void receiveFirst(Configuration& config) {
+		while (receive(config) == 0 && !finished()) {
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wake.wait(lock, [&] { return !batches.empty() || produced.load(std::memory_order_acquire); });
+		}
+	}
+
+private:
+	void produce() {
+		std::string_view text = file.view();
+
+		// Compiled scenes load fast enough to hand over whole
+		if (IsCompiledScene(text)) {
+			std::unique_ptr<Batch> batch(new Batch());
+			if (!LoadCompiledScene(text, batch->config)) {
+				std::cerr << "Error: Compiled scene is corrupt or from an incompatible version." << std::endl;
+				exit(-1);
+			}
+			batch->directives.window = batch->directives.world = batch->directives.font = true;
+			loadReport.compiled = true;
+			record(*batch);
+			publish(batch);
+			text = std::string_view();
+		}
+
+		while (!text.empty() && !stopping) {
+			std::size_t end = text.size();
+			if (batchBytes < text.size()) {
+				const std::size_t newline = text.find('\n', batchBytes);
+				end = newline == std::string_view::npos ? text.size() : newline + 1;
+			}
+
+			std::unique_ptr<Batch> batch(new Batch());
+			batch->directives = ParseConfiguration(text.substr(0, end), batch->config);
+			text.remove_prefix(end);
+
+			record(*batch);
+			publish(batch);
+		}
+		loadReport.totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		produced.store(true, std::memory_order_release);
+		wakeUp();
+	}
+
+	// Adds a parsed batch to the report, the consumer only reads it after the release store of produced
+	void record(const Batch& batch) {
+		if (loadReport.batches++ == 0) {
+			loadReport.firstBatchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		if (verbosity == LoadVerbosity::Shapes) {
+			AppendShapeDump(loadReport.shapeDump, batch.config.shapes, 0);
+		}
+	}
+
+	// Waits for room in the queue, gives up if the loader is being destroyed
+	void publish(std::unique_ptr<Batch>& batch) {
+		if (!batches.push(batch)) {
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wake.wait(lock, [&] { return stopping || batches.push(batch); });
+		}
+		wakeUp();	// The consumer may be waiting for the first batch
+	}
+
+	// The queue itself stays lock-free, the mutex only keeps a wake up from slipping in between a
+	// waiting thread checking the queue and going to sleep. Only one of the two threads ever waits at a
+	// time, the producer on a full queue or the consumer on an empty one
+	void wakeUp() {
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+		}
+		wake.notify_one();
+	}
+
+	MappedFile file;
+	SpscQueue<std::unique_ptr<Batch>> batches;
+	std::size_t batchBytes;
+	LoadVerbosity verbosity;
+	std::chrono::steady_clock::time_point start;
+	LoadReport loadReport;		// Written by the producer until produced is set
+	std::thread producer;
+	std::atomic<bool> stopping{ false };
+	std::atomic<bool> produced{ false };
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	bool receivedAll = false;	// Only touched by the consumer
+};
+
+// --------------------------------------------------------------------------
+
+// Pointers into the contiguous store arrays a kinematics kernel advances, covering shapes [0, count)
+struct KinematicsArrays {
+	float* posX;
+	float* posY;
+	float* speedX;
+	float* speedY;
+	const float* width;
+	const float* height;
+	const std::uint8_t* drawn;
+	std::size_t count;
+
+	// The same arrays offset to cover shapes [begin, end)
+	KinematicsArrays slice(std::size_t begin, std::size_t end) const {
+		return { posX + begin, posY + begin, speedX + begin, speedY + begin,
+			width + begin, height + begin, drawn + begin, end - begin };
+	}
+};
+
+KinematicsArrays GetKinematicsArrays(ShapeStore& shapes) {
+	return { shapes.posX.data(), shapes.posY.data(), shapes.speedX.data(), shapes.speedY.data(),
+		shapes.width.data(), shapes.height.data(), shapes.drawn.data(), shapes.size() };
+}
+
+// Moves every drawn shape in [begin, end) by step times its speed and bounces it off the boundaries
+void IntegrateScalar(const KinematicsArrays& k, std::size_t begin, std::size_t end, float boundsX, float boundsY, float step) {
+	for (std::size_t i = begin; i < end; ++i) {
+		if (!k.drawn[i]) {
+			continue;
+		}
+
+		// Update position
+		k.posX[i] += k.speedX[i] * step;
+		k.posY[i] += k.speedY[i] * step;
+
+		// Check for collision with the window boundaries and reverse the direction of the respective axis.
+		// Both kinds are positioned by the top left of their bounding box, so no kind check is needed
+		float left = k.posX[i];
+		float right = k.posX[i] + k.width[i];
+		float top = k.posY[i];
+		float bottom = k.posY[i] + k.height[i];
+
+		if (left < 0 || right > boundsX) {
+			k.speedX[i] *= -1;
+		}
+		if (top < 0 || bottom > boundsY) {
+			k.speedY[i] *= -1;
+		}
+	}
+}
+
+void IntegrateScalar(const KinematicsArrays& k, float boundsX, float boundsY, float step) {
+	IntegrateScalar(k, 0, k.count, boundsX, boundsY, step);
+}
+
+#ifdef SHAPES_X86
+// The vector kernels do the same as IntegrateScalar without branches. Undrawn lanes get their speed
+// masked to zero for the move and are excluded from the bounce mask, and a bounce flips the sign bit.
+// Shapes past the last full vector go through the scalar loop
+
+void IntegrateSSE2(const KinematicsArrays& k, float boundsX, float boundsY, float step) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 steps = _mm_set1_ps(step);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128 maxX = _mm_set1_ps(boundsX);
+	const __m128 maxY = _mm_set1_ps(boundsY);
+
+	std::size_t i = 0;
+	for (; i + 4 <= k.count; i += 4) {
+		// Widen four drawn bytes into four 32 bit lane masks
+		std::int32_t drawnBytes;
+		std::memcpy(&drawnBytes, k.drawn + i, sizeof(drawnBytes));
+		__m128i drawnWide = _mm_cvtsi32_si128(drawnBytes);
+		drawnWide = _mm_unpacklo_epi8(drawnWide, _mm_setzero_si128());
+		drawnWide = _mm_unpacklo_epi16(drawnWide, _mm_setzero_si128());
+		const __m128 drawn = _mm_castsi128_ps(_mm_cmpgt_epi32(drawnWide, _mm_setzero_si128()));
+
+		__m128 speedX = _mm_loadu_ps(k.speedX + i);
+		__m128 speedY = _mm_loadu_ps(k.speedY + i);
+		const __m128 posX = _mm_add_ps(_mm_loadu_ps(k.posX + i), _mm_and_ps(_mm_mul_ps(speedX, steps), drawn));
+		const __m128 posY = _mm_add_ps(_mm_loadu_ps(k.posY + i), _mm_and_ps(_mm_mul_ps(speedY, steps), drawn));
+
+		const __m128 outX = _mm_or_ps(_mm_cmplt_ps(posX, zero), _mm_cmpgt_ps(_mm_add_ps(posX, _mm_loadu_ps(k.width + i)), maxX));
+		const __m128 outY = _mm_or_ps(_mm_cmplt_ps(posY, zero), _mm_cmpgt_ps(_mm_add_ps(posY, _mm_loadu_ps(k.height + i)), maxY));
+		speedX = _mm_xor_ps(speedX, _mm_and_ps(_mm_and_ps(outX, drawn), signBit));
+		speedY = _mm_xor_ps(speedY, _mm_and_ps(_mm_and_ps(outY, drawn), signBit));
+
+		_mm_storeu_ps(k.posX + i, posX);
+		_mm_storeu_ps(k.posY + i, posY);
+		_mm_storeu_ps(k.speedX + i, speedX);
+		_mm_storeu_ps(k.speedY + i, speedY);
+	}
+	IntegrateScalar(k, i, k.count, boundsX, boundsY, step);
+}
+
+SHAPES_TARGET_AVX2 void IntegrateAVX2(const KinematicsArrays& k, float boundsX, float boundsY, float step) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 steps = _mm256_set1_ps(step);
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	const __m256 maxX = _mm256_set1_ps(boundsX);
+	const __m256 maxY = _mm256_set1_ps(boundsY);
+
+	std::size_t i = 0;
+	for (; i + 8 <= k.count; i += 8) {
+		// Widen eight drawn bytes into eight 32 bit lane masks
+		const __m256i drawnWide = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(k.drawn + i)));
+		const __m256 drawn = _mm256_castsi256_ps(_mm256_cmpgt_epi32(drawnWide, _mm256_setzero_si256()));
+
+		__m256 speedX = _mm256_loadu_ps(k.speedX + i);
+		__m256 speedY = _mm256_loadu_ps(k.speedY + i);
+		const __m256 posX = _mm256_add_ps(_mm256_loadu_ps(k.posX + i), _mm256_and_ps(_mm256_mul_ps(speedX, steps), drawn));
+		const __m256 posY = _mm256_add_ps(_mm256_loadu_ps(k.posY + i), _mm256_and_ps(_mm256_mul_ps(speedY, steps), drawn));
+
+		const __m256 outX = _mm256_or_ps(_mm256_cmp_ps(posX, zero, _CMP_LT_OQ),
+			_mm256_cmp_ps(_mm256_add_ps(posX, _mm256_loadu_ps(k.width + i)), maxX, _CMP_GT_OQ));
+		const __m256 outY = _mm256_or_ps(_mm256_cmp_ps(posY, zero, _CMP_LT_OQ),
+			_mm256_cmp_ps(_mm256_add_ps(posY, _mm256_loadu_ps(k.height + i)), maxY, _CMP_GT_OQ));
+		speedX = _mm256_xor_ps(speedX, _mm256_and_ps(_mm256_and_ps(outX, drawn), signBit));
+		speedY = _mm256_xor_ps(speedY, _mm256_and_ps(_mm256_and_ps(outY, drawn), signBit));
+
+		_mm256_storeu_ps(k.posX + i, posX);
+		_mm256_storeu_ps(k.posY + i, posY);
+		_mm256_storeu_ps(k.speedX + i, speedX);
+		_mm256_storeu_ps(k.speedY + i, speedY);
+	}
+	IntegrateScalar(k, i, k.count, boundsX, boundsY, step);
+}
+
+// AVX2 needs both the CPU instruction set and the OS saving the wider registers on context switches
+bool CpuSupportsAVX2() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuid(info, 1);
+	const bool osSavesAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+	__cpuidex(info, 7, 0);
+	return osSavesAvx && (info[1] & (1 << 5));
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+typedef void (*KinematicsKernel)(const KinematicsArrays&, float, float, float);
+
+struct KinematicsKernelInfo {
+	const char* name;
+	KinematicsKernel kernel;
+};
+
+// Every kernel this CPU can run, the fastest last
+std::vector<KinematicsKernelInfo> AvailableKinematicsKernels() {
+	std::vector<KinematicsKernelInfo> kernels = { { "scalar", IntegrateScalar } };
+#ifdef SHAPES_X86
+	kernels.push_back({ "sse2", IntegrateSSE2 });
+	if (CpuSupportsAVX2()) {
+		kernels.push_back({ "avx2", IntegrateAVX2 });
+	}
+#endif
+	return kernels;
+}
+
+// The kernel is picked once from the CPU features on first use
+const KinematicsKernelInfo& SelectedKinematicsKernel() {
+	static const KinematicsKernelInfo selected = AvailableKinematicsKernels().back();
+	return selected;
+}
+
+// Speeds in the configuration are pixels per tick at this rate, the rate the renderer originally ran at
+const float speedTickRate = 60.0f;
+
+// Advances every drawn shape by dt seconds and bounces it off the boundaries, in parallel chunks
+void UpdatePositions(ShapeStore& shapes, const sf::Vector2u& bounds, JobSystem& jobs, float dt = 1.0f / speedTickRate) {
+	const KinematicsArrays arrays = GetKinematicsArrays(shapes);
+	const KinematicsKernel kernel = SelectedKinematicsKernel().kernel;
+	const float boundsX = static_cast<float>(bounds.x);
+	const float boundsY = static_cast<float>(bounds.y);
+	const float step = dt * speedTickRate;
+
+	jobs.parallelFor(arrays.count, 16384, [&](std::size_t begin, std::size_t end) {
+		kernel(arrays.slice(begin, end), boundsX, boundsY, step);
+	});
+}
+
+// --------------------------------------------------------------------------
+
+// Uniform grid over the bounds, rebuilt every tick from the store. Each drawn shape is listed in every
+// cell its bounding box touches, so two shapes can only overlap if they share a cell. Shapes that have
+// left the bounds are clamped into the edge cells, which keeps that guarantee
+class CollisionGrid {
+public:
+	void build(const ShapeStore& shapes, float boundsX, float boundsY) {
+		// Cells about twice the average shape, but never more than a few cells per shape
+		double extentSum = 0.0;
+		std::size_t count = 0;
+		for (std::size_t i = 0; i < shapes.size(); ++i) {
+			if (shapes.drawn[i]) {
+				extentSum += std::max(shapes.width[i], shapes.height[i]);
+				++count;
+			}
+		}
+		cellSize = count > 0 ? static_cast<float>(2.0 * extentSum / count) : 1.0f;
+		cellSize = std::max({ cellSize, 1.0f, std::sqrt(boundsX * boundsY / (4.0f * count + 1.0f)) });
+		inverseCellSize = 1.0f / cellSize;
+		columns = std::max(1, static_cast<int>(std::ceil(boundsX * inverseCellSize)));
+		rows = std::max(1, static_cast<int>(std::ceil(boundsY * inverseCellSize)));
+
+		// Counting sort: count the entries of every cell, turn the counts into offsets, then fill the
+		// cells in shape order so every cell lists its shapes by increasing index
+		const std::size_t cells = static_cast<std::size_t>(columns) * rows;
+		cellStart.assign(cells + 1, 0);
+		for (std::size_t i = 0; i < shapes.size(); ++i) {
+			if (shapes.drawn[i]) {
+				forEachCell(shapes, i, [&](std::size_t cell) { ++cellStart[cell + 1]; });
+			}
+		}
+		for (std::size_t cell = 0; cell < cells; ++cell) {
+			cellStart[cell + 1] += cellStart[cell];
+		}
+
+		entries.resize(cellStart[cells]);
+		cursor.assign(cellStart.begin(), cellStart.end() - 1);
+		for (std::size_t i = 0; i < shapes.size(); ++i) {
+			if (shapes.drawn[i]) {
+				forEachCell(shapes, i, [&](std::size_t cell) { entries[cursor[cell]++] = static_cast<std::uint32_t>(i); });
+			}
+		}
+	}
+
+	std::size_t cellCount() const {
+		return cellStart.size() - 1;
+	}
+
+	// Index of the cell containing the point, clamped to the grid
+	std::size_t cellAt(float x, float y) const {
+		return static_cast<std::size_t>(row(y)) * columns + column(x);
+	}
+
+	// Shapes listed in the cell, by increasing index
+	const std::uint32_t* cellBegin(std::size_t cell) const {
+		return entries.data() + cellStart[cell];
+	}
+
+	const std::uint32_t* cellEnd(std::size_t cell) const {
+		return entries.data() + cellStart[cell + 1];
+	}
+
+private:
+	int column(float x) const {
+		return static_cast<int>(std::min(std::max(x * inverseCellSize, 0.0f), static_cast<float>(columns - 1)));
+	}
+
+	int row(float y) const {
+		return static_cast<int>(std::min(std::max(y * inverseCellSize, 0.0f), static_cast<float>(rows - 1)));
+	}
+
+	template <typename Fn>
+	void forEachCell(const ShapeStore& shapes, std::size_t i, Fn fn) const {
+		const int firstColumn = column(shapes.posX[i]), lastColumn = column(shapes.posX[i] + shapes.width[i]);
+		const int firstRow = row(shapes.posY[i]), lastRow = row(shapes.posY[i] + shapes.height[i]);
+		for (int y = firstRow; y <= lastRow; ++y) {
+			for (int x = firstColumn; x <= lastColumn; ++x) {
+				fn(static_cast<std::size_t>(y) * columns + x);
+			}
+		}
+	}
+
+	float cellSize = 1.0f;
+	float inverseCellSize = 1.0f;
+	int columns = 1;
+	int rows = 1;
+	std::vector<std::uint32_t> cellStart;	// Offset of every cell's first entry, plus the total at the end
+	std::vector<std::uint32_t> entries;		// Shape indices grouped by cell
+	std::vector<std::uint32_t> cursor;		// Next free entry of every cell while filling
+};
+
+// Two overlapping shapes, the normal points from a to b and depth is how far they overlap along it
+struct Contact {
+	std::uint32_t a, b;
+	float normalX, normalY;
+	float depth;
+};
+
+// Circle against rectangle, the normal points from the rectangle to the circle
+bool CollideCircleRectangle(const ShapeStore& shapes, std::uint32_t circle, std::uint32_t rectangle, float& normalX, float& normalY, float& depth) {
+	const float radius = shapes.radius(circle);
+	const float centreX = shapes.posX[circle] + radius, centreY = shapes.posY[circle] + radius;
+	const float left = shapes.posX[rectangle], right = left + shapes.width[rectangle];
+	const float top = shapes.posY[rectangle], bottom = top + shapes.height[rectangle];
+
+	const float dx = centreX - std::min(std::max(centreX, left), right);
+	const float dy = centreY - std::min(std::max(centreY, top), bottom);
+	const float distanceSquared = dx * dx + dy * dy;
+	if (distanceSquared > 0.0f) {
+		if (distanceSquared >= radius * radius) {
+			return false;
+		}
+		const float distance = std::sqrt(distanceSquared);
+		normalX = dx / distance;
+		normalY = dy / distance;
+		depth = radius - distance;
+		return true;
+	}
+
+	// The centre is inside the rectangle, push the circle out through the nearest side
+	const float toLeft = centreX - left, toRight = right - centreX, toTop = centreY - top, toBottom = bottom - centreY;
+	const float nearest = std::min({ toLeft, toRight, toTop, toBottom });
+	normalX = nearest == toLeft ? -1.0f : nearest == toRight ? 1.0f : 0.0f;
+	normalY = normalX != 0.0f ? 0.0f : nearest == toTop ? -1.0f : 1.0f;
+	depth = radius + nearest;
+	return true;
+}
+
+// Narrow-phase test of a pair whose bounding boxes overlap, fills in contact when the shapes touch
+bool CollideShapes(const ShapeStore& shapes, std::uint32_t a, std::uint32_t b, Contact& contact) {
+	contact.a = a;
+	contact.b = b;
+
+	const bool circleA = shapes.kinds[a] == ShapeKind::Circle;
+	const bool circleB = shapes.kinds[b] == ShapeKind::Circle;
+	if (circleA && circleB) {
+		const float radiusA = shapes.radius(a), radiusB = shapes.radius(b);
+		const float dx = (shapes.posX[b] + radiusB) - (shapes.posX[a] + radiusA);
+		const float dy = (shapes.posY[b] + radiusB) - (shapes.posY[a] + radiusA);
+		const float distanceSquared = dx * dx + dy * dy;
+		const float reach = radiusA + radiusB;
+		if (distanceSquared >= reach * reach) {
+			return false;
+		}
+		const float distance = std::sqrt(distanceSquared);
+		contact.normalX = distance > 0.0f ? dx / distance : 1.0f;
+		contact.normalY = distance > 0.0f ? dy / distance : 0.0f;
+		contact.depth = reach - distance;
+		return true;
+	}
+	if (circleA) {
+		if (!CollideCircleRectangle(shapes, a, b, contact.normalX, contact.normalY, contact.depth)) {
+			return false;
+		}
+		contact.normalX = -contact.normalX;
+		contact.normalY = -contact.normalY;
+		return true;
+	}
+	if (circleB) {
+		return CollideCircleRectangle(shapes, b, a, contact.normalX, contact.normalY, contact.depth);
+	}
+
+	// Rectangles separate along the axis they overlap least on
+	const float overlapX = std::min(shapes.posX[a] + shapes.width[a], shapes.posX[b] + shapes.width[b]) - std::max(shapes.posX[a], shapes.posX[b]);
+	const float overlapY = std::min(shapes.posY[a] + shapes.height[a], shapes.posY[b] + shapes.height[b]) - std::max(shapes.posY[a], shapes.posY[b]);
+	if (overlapX <= 0.0f || overlapY <= 0.0f) {
+		return false;
+	}
+	const float dx = (shapes.posX[b] + shapes.width[b] * 0.5f) - (shapes.posX[a] + shapes.width[a] * 0.5f);
+	const float dy = (shapes.posY[b] + shapes.height[b] * 0.5f) - (shapes.posY[a] + shapes.height[a] * 0.5f);
+	if (overlapX < overlapY) {
+		contact.normalX = dx < 0.0f ? -1.0f : 1.0f;
+		contact.normalY = 0.0f;
+		contact.depth = overlapX;
+	}
+	else {
+		contact.normalX = 0.0f;
+		contact.normalY = dy < 0.0f ? -1.0f : 1.0f;
+		contact.depth = overlapY;
+	}
+	return true;
+}
+
+// Pushes the two shapes of a contact apart and, if they are closing in, bounces them off each other
+// elastically like the window edges do. Heavier shapes, by bounding box area, move less
+void ResolveContact(ShapeStore& shapes, const Contact& contact) {
+	const std::uint32_t a = contact.a, b = contact.b;
+	const float inverseMassA = 1.0f / std::max(shapes.width[a] * shapes.height[a], 1.0f);
+	const float inverseMassB = 1.0f / std::max(shapes.width[b] * shapes.height[b], 1.0f);
+	const float inverseMassSum = inverseMassA + inverseMassB;
+
+	const float push = contact.depth / inverseMassSum;
+	shapes.posX[a] -= contact.normalX * push * inverseMassA;
+	shapes.posY[a] -= contact.normalY * push * inverseMassA;
+	shapes.posX[b] += contact.normalX * push * inverseMassB;
+	shapes.posY[b] += contact.normalY * push * inverseMassB;
+
+	const float approach = (shapes.speedX[b] - shapes.speedX[a]) * contact.normalX + (shapes.speedY[b] - shapes.speedY[a]) * contact.normalY;
+	if (approach < 0.0f) {
+		const float impulse = -2.0f * approach / inverseMassSum;
+		shapes.speedX[a] -= contact.normalX * impulse * inverseMassA;
+		shapes.speedY[a] -= contact.normalY * impulse * inverseMassA;
+		shapes.speedX[b] += contact.normalX * impulse * inverseMassB;
+		shapes.speedY[b] += contact.normalY * impulse * inverseMassB;
+	}
+}
+
+// Shape-to-shape collisions, run after UpdatePositions every tick. The narrow phase runs on the
+// worker threads, the contacts it finds are resolved on the calling thread
+class CollisionSystem {
+public:
+	bool enabled = true;
+
+	void step(ShapeStore& shapes, const sf::Vector2u& bounds, JobSystem& jobs) {
+		contacts.clear();
+		if (!enabled) {
+			return;
+		}
+
+		grid.build(shapes, static_cast<float>(bounds.x), static_cast<float>(bounds.y));
+
+		// Cells are split into fixed blocks, each gathering its contacts into its own buffer. The blocks do
+		// not depend on the thread count and are joined in cell order, so the contacts and the result of
+		// resolving them one after the other are the same however many threads took part
+		const std::size_t blocks = (grid.cellCount() + cellsPerBlock - 1) / cellsPerBlock;
+		if (blockContacts.size() < blocks) {
+			blockContacts.resize(blocks);
+		}
+		jobs.parallelFor(blocks, 1, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t block = begin; block < end; ++block) {
+				std::vector<Contact>& found = blockContacts[block];
+				found.clear();
+
+				const std::size_t lastCell = std::min((block + 1) * cellsPerBlock, grid.cellCount());
+				for (std::size_t cell = block * cellsPerBlock; cell < lastCell; ++cell) {
+					findContacts(shapes, cell, found);
+				}
+			}
+		});
+		for (std::size_t block = 0; block < blocks; ++block) {
+			contacts.insert(contacts.end(), blockContacts[block].begin(), blockContacts[block].end());
+		}
+
+		for (const Contact& contact : contacts) {
+			ResolveContact(shapes, contact);
+		}
+
+		// A push can move a shape past a window edge, where the bounce in UpdatePositions would flip its
+		// speed every tick and trap it, so pushed shapes are kept inside
+		const float boundsX = static_cast<float>(bounds.x), boundsY = static_cast<float>(bounds.y);
+		for (const Contact& contact : contacts) {
+			for (std::uint32_t i : { contact.a, contact.b }) {
+				shapes.posX[i] = std::max(std::min(shapes.posX[i], boundsX - shapes.width[i]), 0.0f);
+				shapes.posY[i] = std::max(std::min(shapes.posY[i], boundsY - shapes.height[i]), 0.0f);
+			}
+		}
+	}
+
+	// Contacts found in the last step
+	std::size_t contactCount() const {
+		return contacts.size();
+	}
+
+	const CollisionGrid& spatialGrid() const {
+		return grid;
+	}
+
+private:
+	// Tests every pair listed in the cell. A pair sharing several cells is only taken in the one holding
+	// the top left corner of the overlap of their bounding boxes
+	void findContacts(const ShapeStore& shapes, std::size_t cell, std::vector<Contact>& found) const {
+		const std::uint32_t* begin = grid.cellBegin(cell);
+		const std::uint32_t* end = grid.cellEnd(cell);
+		for (const std::uint32_t* first = begin; first != end; ++first) {
+			const std::uint32_t a = *first;
+			const float leftA = shapes.posX[a], rightA = leftA + shapes.width[a];
+			const float topA = shapes.posY[a], bottomA = topA + shapes.height[a];
+
+			for (const std::uint32_t* second = first + 1; second != end; ++second) {
+				const std::uint32_t b = *second;
+				const float leftB = shapes.posX[b], topB = shapes.posY[b];
+				if (leftB > rightA || leftB + shapes.width[b] < leftA || topB > bottomA || topB + shapes.height[b] < topA) {
+					continue;
+				}
+				if (grid.cellAt(std::max(leftA, leftB), std::max(topA, topB)) != cell) {
+					continue;
+				}
+
+				Contact contact;
+				if (CollideShapes(shapes, a, b, contact)) {
+					found.push_back(contact);
+				}
+			}
+		}
+	}
+
+	static const std::size_t cellsPerBlock = 256;
+
+	CollisionGrid grid;
+	std::vector<Contact> contacts;
+	std::vector<std::vector<Contact>> blockContacts;	// Kept between steps so the buffers stay allocated
+};
+
+// --------------------------------------------------------------------------
+
+// Where the renderer places the shapes, part way between their positions before and after a tick
+struct FramePositions {
+	const float* previousX;
+	const float* previousY;
+	const float* currentX;
+	const float* currentY;
+	float alpha;	// 0 draws the previous positions, 1 the current ones
+};
+
+// The positions in the store as they are, without interpolation
+FramePositions CurrentPositions(const ShapeStore& shapes) {
+	return { shapes.posX.data(), shapes.posY.data(), shapes.posX.data(), shapes.posY.data(), 1.0f };
+}
+
+// The positions one frame is drawn at, interpolated once so that drawing, culling and picking all place
+// the shapes exactly where they appear on screen
+struct DrawnPositions {
+	std::vector<float> x, y;
+
+	void update(const FramePositions& positions, std::size_t count, JobSystem& jobs) {
+		x.resize(count);
+		y.resize(count);
+		jobs.parallelFor(count, 4096, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i) {
+				x[i] = positions.previousX[i] + (positions.currentX[i] - positions.previousX[i]) * positions.alpha;
+				y[i] = positions.previousY[i] + (positions.currentY[i] - positions.previousY[i]) * positions.alpha;
+			}
+		});
+	}
+
+	FramePositions positions() const {
+		return { x.data(), y.data(), x.data(), y.data(), 1.0f };
+	}
+};
+
+// Runs the simulation in ticks of a fixed length however long the frames take. Each frame adds its
+// duration and runs as many whole ticks as fit, the time left over places the drawn shapes part way
+// between the positions before and after the last tick
+class FixedTimestep {
+public:
+	explicit FixedTimestep(float tickSeconds) : tickSeconds(tickSeconds) {}
+
+	// Returns the number of ticks run. A hitch longer than maxFrameSeconds slows the simulation down
+	// rather than making the next frame even longer
+	template <typename Tick>
+	int advance(float frameSeconds, ShapeStore& shapes, const Tick& tick) {
+		accumulator += std::min(frameSeconds, maxFrameSeconds);
+		const int ticks = static_cast<int>(accumulator / tickSeconds);
+		accumulator -= ticks * tickSeconds;
+
+		for (int t = 0; t < ticks; ++t) {
+			// Only the positions before the last tick are ever drawn
+			if (t == ticks - 1) {
+				previousX.assign(shapes.posX.begin(), shapes.posX.end());
+				previousY.assign(shapes.posY.begin(), shapes.posY.end());
+			}
+			tick(tickSeconds);
+		}
+		return ticks;
+	}
+
+	FramePositions positions(const ShapeStore& shapes) const {
+		// Shapes added since the last tick have no previous position yet
+		if (previousX.size() != shapes.size()) {
+			return CurrentPositions(shapes);
+		}
+		return { previousX.data(), previousY.data(), shapes.posX.data(), shapes.posY.data(), accumulator / tickSeconds };
+	}
+
+	float tickLength() const {
+		return tickSeconds;
+	}
+
+private:
+	static constexpr float maxFrameSeconds = 0.25f;
+
+	float tickSeconds;
+	float accumulator = 0.0f;
+	std::vector<float> previousX, previousY;
+};
+
+// Positions the renderer draws from, written by the simulation thread once a frame's ticks are done
+struct SimulationSnapshot {
+	std::vector<float> previousX, previousY;
+	std::vector<float> currentX, currentY;
+	float alpha = 1.0f;
+
+	FramePositions positions() const {
+		return { previousX.data(), previousY.data(), currentX.data(), currentY.data(), alpha };
+	}
+};
+
+// Runs the fixed ticks of each frame on a thread of its own while the main thread draws what the
+// ticks of the frame before left in the snapshot. Both threads meet once a frame in sync, where the
+// snapshots are swapped and the main thread may change the shapes while the simulation is idle.
+// While ticks are running the main thread only reads the fields they leave alone: kind, size,
+// colour, segments and drawn
+class SimulationThread {
+public:
+	SimulationThread(ShapeStore& shapes, CollisionSystem& collisions, JobSystem& jobs, float tickSeconds)
+		: shapes(shapes), collisions(collisions), jobs(jobs), timestep(tickSeconds), thread(&SimulationThread::run, this) {
+	}
+
+	~SimulationThread() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		changed.notify_all();
+		thread.join();
+	}
+
+	SimulationThread(const SimulationThread&) = delete;
+	SimulationThread& operator=(const SimulationThread&) = delete;
+
+	// Waits for the ticks started by the last start, then makes their result the snapshot to draw
+	void sync() {
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this]() { return !busy; });
+		std::swap(front, back);
+	}
+
+	// Starts the ticks for a frame that took frameSeconds. The shapes must not be changed, and only the
+	// fields listed above read, until the next sync
+	void start(float frameSeconds, const sf::Vector2u& bounds) {
+		// Shapes added since the last tick are drawn where they start until the simulation catches up
+		for (std::size_t i = front.currentX.size(); i < shapes.size(); ++i) {
+			front.previousX.push_back(shapes.posX[i]);
+			front.previousY.push_back(shapes.posY[i]);
+			front.currentX.push_back(shapes.posX[i]);
+			front.currentY.push_back(shapes.posY[i]);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pendingSeconds = frameSeconds;
+			pendingBounds = bounds;
+			busy = true;
+		}
+		changed.notify_all();
+	}
+
+	// Stays the same from one sync to the next
+	const SimulationSnapshot& snapshot() const {
+		return front;
+	}
+
+private:
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			changed.wait(lock, [this]() { return busy || stopping; });
+			if (!busy) {
+				return;
+			}
+			const float frameSeconds = pendingSeconds;
+			const sf::Vector2u bounds = pendingBounds;
+			lock.unlock();
+
+			{
+				ProfileScope zone("Simulate");
+				timestep.advance(frameSeconds, shapes, [&](float dt) {
+					{
+						ProfileScope kinematicsZone("Kinematics");
+						UpdatePositions(shapes, bounds, jobs, dt);
+					}
+					ProfileScope collisionsZone("Collisions");
+					collisions.step(shapes, bounds, jobs);
+				});
+
+				ProfileScope snapshotZone("Snapshot");
+				const FramePositions positions = timestep.positions(shapes);
+				const std::size_t count = shapes.size();
+				back.previousX.assign(positions.previousX, positions.previousX + count);
+				back.previousY.assign(positions.previousY, positions.previousY + count);
+				back.currentX.assign(positions.currentX, positions.currentX + count);
+				back.currentY.assign(positions.currentY, positions.currentY + count);
+				back.alpha = positions.alpha;
+			}
+
+			lock.lock();
+			busy = false;
+			changed.notify_all();
+		}
+	}
+
+	ShapeStore& shapes;
+	CollisionSystem& collisions;
+	JobSystem& jobs;
+	FixedTimestep timestep;
+
+	SimulationSnapshot front;	// Drawn by the main thread
+	SimulationSnapshot back;	// Written by the simulation thread
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	float pendingSeconds = 0.0f;
+	sf::Vector2u pendingBounds;
+	bool busy = false;
+	bool stopping = false;
+
+	std::thread thread;		// Last, so everything it uses exists before it starts
+};
+
+// --------------------------------------------------------------------------
+
+// Loose grid of shapes kept up to date from frame to frame. Each shape is listed once, in the cell
+// holding the centre of its bounding box, and remembers its slot there, so a shape that moves into
+// another cell is taken out and added in constant time. Shapes no bigger than a cell reach at most
+// half a cell outside their own, so a query only has to widen its area by that much. The few larger
+// ones share one extra list that every query checks
+class SpatialIndex {
+public:
+	static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+	// Brings the grid in line with the positions given, x and y hold at least shapes.size() entries.
+	// Changing the bounds lays out a new grid and inserts every shape again
+	void update(const ShapeStore& shapes, const float* x, const float* y, float boundsX, float boundsY, JobSystem& jobs) {
+		if (boundsX != gridBoundsX || boundsY != gridBoundsY) {
+			layout(boundsX, boundsY);
+		}
+
+		// Shapes new to the index start out in no cell
+		where.resize(shapes.size(), none);
+		slot.resize(shapes.size(), 0);
+		next.resize(shapes.size());
+		jobs.parallelFor(shapes.size(), 4096, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i) {
+				next[i] = cellFor(shapes, x[i], y[i], i);
+			}
+		});
+
+		for (std::size_t i = 0; i < shapes.size(); ++i) {
+			if (next[i] != where[i]) {
+				remove(static_cast<std::uint32_t>(i));
+				insert(static_cast<std::uint32_t>(i), next[i]);
+			}
+		}
+	}
+
+	// The topmost shape containing the point, the one drawn last, or npos
+	std::size_t pick(const ShapeStore& shapes, const float* x, const float* y, float pointX, float pointY) const {
+		std::size_t picked = npos;
+		query(pointX, pointY, pointX, pointY, [&](std::uint32_t i) {
+			if ((picked == npos || i > picked) && contains(shapes, x[i], y[i], i, pointX, pointY)) {
+				picked = i;
+			}
+		});
+		return picked;
+	}
+
+	// Calls fn(i) once for every shape that may overlap the area, a superset of the shapes that do
+	template <typename Fn>
+	void query(float left, float top, float right, float bottom, const Fn& fn) const {
+		if (cells.empty()) {
+			return;
+		}
+
+		const float reach = cellSize * 0.5f;
+		const int firstColumn = column(left - reach), lastColumn = column(right + reach);
+		const int firstRow = row(top - reach), lastRow = row(bottom + reach);
+		for (int r = firstRow; r <= lastRow; ++r) {
+			for (int c = firstColumn; c <= lastColumn; ++c) {
+				for (std::uint32_t i : cells[static_cast<std::size_t>(r) * columns + c]) {
+					fn(i);
+				}
+			}
+		}
+		for (std::uint32_t i : cells.back()) {
+			fn(i);
+		}
+	}
+
+private:
+	static constexpr std::uint32_t none = 0xFFFFFFFFu;	// Not drawn, so in no cell
+
+	// Cells of at least 64 units, made larger when the bounds would otherwise need too many of them
+	void layout(float boundsX, float boundsY) {
+		const float maxCells = 1 << 18;
+		gridBoundsX = boundsX;
+		gridBoundsY = boundsY;
+		cellSize = std::max(64.0f, std::sqrt(boundsX * boundsY / maxCells));
+		inverseCellSize = 1.0f / cellSize;
+		columns = std::max(1, static_cast<int>(std::ceil(boundsX * inverseCellSize)));
+		rows = std::max(1, static_cast<int>(std::ceil(boundsY * inverseCellSize)));
+
+		// One more list after the grid cells holds the shapes bigger than a cell
+		cells.assign(static_cast<std::size_t>(columns) * rows + 1, std::vector<std::uint32_t>());
+		where.clear();
+		slot.clear();
+	}
+
+	int column(float x) const {
+		return static_cast<int>(std::min(std::max(x * inverseCellSize, 0.0f), static_cast<float>(columns - 1)));
+	}
+
+	int row(float y) const {
+		return static_cast<int>(std::min(std::max(y * inverseCellSize, 0.0f), static_cast<float>(rows - 1)));
+	}
+
+	std::uint32_t cellFor(const ShapeStore& shapes, float x, float y, std::size_t i) const {
+		if (!shapes.drawn[i]) {
+			return none;
+		}
+		if (std::max(shapes.width[i], shapes.height[i]) > cellSize) {
+			return static_cast<std::uint32_t>(cells.size() - 1);
+		}
+		return static_cast<std::uint32_t>(row(y + shapes.height[i] * 0.5f) * columns + column(x + shapes.width[i] * 0.5f));
+	}
+
+	// Moves the last shape of the cell into the freed slot
+	void remove(std::uint32_t i) {
+		if (where[i] == none) {
+			return;
+		}
+		std::vector<std::uint32_t>& cell = cells[where[i]];
+		const std::uint32_t last = cell.back();
+		cell[slot[i]] = last;
+		slot[last] = slot[i];
+		cell.pop_back();
+		where[i] = none;
+	}
+
+	void insert(std::uint32_t i, std::uint32_t cell) {
+		if (cell != none) {
+			slot[i] = static_cast<std::uint32_t>(cells[cell].size());
+			cells[cell].push_back(i);
+		}
+		where[i] = cell;
+	}
+
+	static bool contains(const ShapeStore& shapes, float x, float y, std::size_t i, float pointX, float pointY) {
+		if (shapes.kinds[i] == ShapeKind::Circle) {
+			const float radius = shapes.radius(i);
+			const float dx = pointX - (x + radius), dy = pointY - (y + radius);
+			return dx * dx + dy * dy <= radius * radius;
+		}
+		return pointX >= x && pointX <= x + shapes.width[i] && pointY >= y && pointY <= y + shapes.height[i];
+	}
+
+	float gridBoundsX = -1.0f, gridBoundsY = -1.0f;
+	float cellSize = 64.0f;
+	float inverseCellSize = 1.0f / 64.0f;
+	int columns = 0;
+	int rows = 0;
+	std::vector<std::vector<std::uint32_t>> cells;	// Shape indices per cell in no particular order, large shapes last
+	std::vector<std::uint32_t> where;				// Cell each shape is listed in
+	std::vector<std::uint32_t> slot;				// Position of each shape in its cell's list
+	std::vector<std::uint32_t> next;				// Cell each shape belongs in now, reused between updates
+};
+
+// --------------------------------------------------------------------------
+
+// Unit circle outlines keyed by segment count. Each outline is computed the first time a circle
+// with that many segments is drawn and reused by every circle after that. Entries are never moved,
+// so the renderer can hold on to the returned references
+class TessellationCache {
+public:
+	// Returns segments + 1 points, the last repeating the first to close the loop. Empty below 3 segments
+	const std::vector<sf::Vector2f>& get(std::size_t segments) {
+		std::vector<sf::Vector2f>& outline = outlines[segments];
+		if (outline.empty() && segments >= 3) {
+			const float pi = 3.141592654f;
+			outline.reserve(segments + 1);
+			for (std::size_t s = 0; s <= segments; ++s) {
+				const float angle = s * 2 * pi / segments - pi / 2;
+				outline.emplace_back(std::cos(angle), std::sin(angle));
+			}
+		}
+		return outline;
+	}
+
+private:
+	std::map<std::size_t, std::vector<sf::Vector2f>> outlines;
+};
+
+// Shaders for drawing circles as signed distance fields. Every shape becomes one quad whose texture
+// coordinates run from -1 to 1 across a circle and stay at 0 for a rectangle, and the fragment shader
+// fades out everything past distance 1 with a one pixel anti-aliased edge
+const char* sdfVertexShader = R"(
+#version 110
+void main() {
+	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+	gl_TexCoord[0] = gl_MultiTexCoord0;
+	gl_FrontColor = gl_Color;
+}
+)";
+
+const char* sdfFragmentShader = R"(
+#version 110
+void main() {
+	float distance = length(gl_TexCoord[0].xy);
+	float edge = max(fwidth(distance), 0.0001);
+	float coverage = 1.0 - smoothstep(1.0 - edge, 1.0, distance);
+	gl_FragColor = vec4(gl_Color.rgb, gl_Color.a * coverage);
+}
+)";
+
+// Vertex shader of the instanced path. Every instance stretches the unit quad over one shape's bounding
+// box and gives circles the same -1 to 1 texture coordinates as the SDF quads, so it shares their
+// fragment shader
+const char* instancedVertexShader = R"(
+#version 110
+uniform mat4 viewMatrix;
+attribute vec2 corner;
+attribute vec4 bounds;
+attribute vec4 colour;
+attribute float circle;
+void main() {
+	gl_Position = viewMatrix * vec4(bounds.xy + corner * bounds.zw, 0.0, 1.0);
+	gl_TexCoord[0] = vec4((corner * 2.0 - 1.0) * circle, 0.0, 1.0);
+	gl_FrontColor = colour;
+}
+)";
+
+// Per-shape data the instanced path streams to the GPU every frame
+struct ShapeInstance {
+	float x, y, width, height;	// Bounding box in world units, a hidden shape has a zero size
+	sf::Color colour;
+	float circle;				// 1 for circles, 0 for rectangles
+};
+
+// Draws shapes with one instanced draw call: a unit quad uploaded once and a ShapeInstance per shape
+// streamed each frame. SFML has no instanced drawing and the tree no OpenGL loader, so the calls are
+// looked up through sf::Context::getFunction. Like sf::Shader it needs an OpenGL context to be created,
+// which the window provides
+class InstancedShapeRenderer : private sf::GlResource {
+public:
+	~InstancedShapeRenderer() {
+		if (buffers[0] != 0) {
+			TransientContextLock lock;
+			gl.deleteBuffers(2, buffers);
+		}
+	}
+
+	// False when the driver lacks instancing or the shader does not build, the caller then keeps drawing
+	// through sf::RenderTarget
+	bool load() {
+		TransientContextLock lock;
+		if (!sf::Shader::isAvailable() || !sf::Context::isExtensionAvailable("GL_ARB_instanced_arrays") ||
+			!sf::Context::isExtensionAvailable("GL_ARB_draw_instanced") || !gl.load()) {
+			return false;
+		}
+
+		// SFML links the program itself, the attributes are given fixed locations by linking it again
+		if (!shader.loadFromMemory(instancedVertexShader, sdfFragmentShader)) {
+			return false;
+		}
+		const char* attributes[] = { "corner", "bounds", "colour", "circle" };
+		for (unsigned int location = 0; location < 4; ++location) {
+			gl.bindAttribLocation(shader.getNativeHandle(), location, attributes[location]);
+		}
+		gl.linkProgram(shader.getNativeHandle());
+		int linked = 0;
+		gl.getProgramiv(shader.getNativeHandle(), glLinkStatus, &linked);
+		if (!linked) {
+			return false;
+		}
+
+		const float corners[] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+		gl.genBuffers(2, buffers);
+		gl.bindBuffer(glArrayBuffer, buffers[0]);
+		gl.bufferData(glArrayBuffer, sizeof(corners), corners, glStaticDraw);
+		gl.bindBuffer(glArrayBuffer, 0);
+		return true;
+	}
+
+	void draw(sf::RenderTarget& target, const std::vector<ShapeInstance>& instances) {
+		if (instances.empty() || !target.setActive(true)) {
+			return;
+		}
+
+		// Start from SFML's blending and clear the client side arrays it draws from, they may point at
+		// vertices that no longer exist
+		target.resetGLStates();
+		gl.disableClientState(glVertexArray);
+		gl.disableClientState(glColorArray);
+		gl.disableClientState(glTextureCoordArray);
+
+		const sf::View& view = target.getView();
+		const sf::IntRect viewport = target.getViewport(view);
+		gl.viewport(viewport.left, static_cast<int>(target.getSize().y) - viewport.top - viewport.height, viewport.width, viewport.height);
+		shader.setUniform("viewMatrix", sf::Glsl::Mat4(view.getTransform()));
+		sf::Shader::bind(&shader);
+
+		gl.bindBuffer(glArrayBuffer, buffers[0]);
+		gl.enableVertexAttribArray(0);
+		gl.vertexAttribPointer(0, 2, glFloat, false, 0, nullptr);
+
+		// A new buffer every frame lets the driver keep drawing from last frame's while this one uploads
+		const int stride = sizeof(ShapeInstance);
+		gl.bindBuffer(glArrayBuffer, buffers[1]);
+		gl.bufferData(glArrayBuffer, static_cast<std::ptrdiff_t>(instances.size() * sizeof(ShapeInstance)), instances.data(), glStreamDraw);
+		gl.vertexAttribPointer(1, 4, glFloat, false, stride, reinterpret_cast<const void*>(offsetof(ShapeInstance, x)));
+		gl.vertexAttribPointer(2, 4, glUnsignedByte, true, stride, reinterpret_cast<const void*>(offsetof(ShapeInstance, colour)));
+		gl.vertexAttribPointer(3, 1, glFloat, false, stride, reinterpret_cast<const void*>(offsetof(ShapeInstance, circle)));
+		for (unsigned int location = 1; location < 4; ++location) {
+			gl.enableVertexAttribArray(location);
+			gl.vertexAttribDivisor(location, 1);
+		}
+
+		gl.drawArraysInstanced(glTriangleStrip, 0, 4, static_cast<int>(instances.size()));
+
+		// Generic attributes can alias the ones SFML draws with, so none is left enabled or instanced
+		for (unsigned int location = 0; location < 4; ++location) {
+			gl.vertexAttribDivisor(location, 0);
+			gl.disableVertexAttribArray(location);
+		}
+		gl.bindBuffer(glArrayBuffer, 0);
+		sf::Shader::bind(nullptr);
+		target.resetGLStates();
+	}
+
+private:
+	// The OpenGL enums used, the tree includes no OpenGL header
+	static const unsigned int glFloat = 0x1406;
+	static const unsigned int glUnsignedByte = 0x1401;
+	static const unsigned int glTriangleStrip = 0x0005;
+	static const unsigned int glArrayBuffer = 0x8892;
+	static const unsigned int glStaticDraw = 0x88E4;
+	static const unsigned int glStreamDraw = 0x88E0;
+	static const unsigned int glLinkStatus = 0x8B82;
+	static const unsigned int glVertexArray = 0x8074;
+	static const unsigned int glColorArray = 0x8076;
+	static const unsigned int glTextureCoordArray = 0x8078;
+
+	struct Functions {
+		void (SHAPES_GL_API* genBuffers)(int, unsigned int*);
+		void (SHAPES_GL_API* deleteBuffers)(int, const unsigned int*);
+		void (SHAPES_GL_API* bindBuffer)(unsigned int, unsigned int);
+		void (SHAPES_GL_API* bufferData)(unsigned int, std::ptrdiff_t, const void*, unsigned int);
+		void (SHAPES_GL_API* bindAttribLocation)(unsigned int, unsigned int, const char*);
+		void (SHAPES_GL_API* linkProgram)(unsigned int);
+		void (SHAPES_GL_API* getProgramiv)(unsigned int, unsigned int, int*);
+		void (SHAPES_GL_API* enableVertexAttribArray)(unsigned int);
+		void (SHAPES_GL_API* disableVertexAttribArray)(unsigned int);
+		void (SHAPES_GL_API* vertexAttribPointer)(unsigned int, int, unsigned int, unsigned char, int, const void*);
+		void (SHAPES_GL_API* vertexAttribDivisor)(unsigned int, unsigned int);
+		void (SHAPES_GL_API* drawArraysInstanced)(unsigned int, int, int, int);
+		void (SHAPES_GL_API* disableClientState)(unsigned int);
+		void (SHAPES_GL_API* viewport)(int, int, int, int);
+
+		// The instancing calls under their extension names, which every driver listing the extensions has
+		bool load() {
+			return find(genBuffers, "glGenBuffers") && find(deleteBuffers, "glDeleteBuffers") &&
+				find(bindBuffer, "glBindBuffer") && find(bufferData, "glBufferData") &&
+				find(bindAttribLocation, "glBindAttribLocation") && find(linkProgram, "glLinkProgram") &&
+				find(getProgramiv, "glGetProgramiv") && find(enableVertexAttribArray, "glEnableVertexAttribArray") &&
+				find(disableVertexAttribArray, "glDisableVertexAttribArray") && find(vertexAttribPointer, "glVertexAttribPointer") &&
+				find(vertexAttribDivisor, "glVertexAttribDivisorARB") && find(drawArraysInstanced, "glDrawArraysInstancedARB") &&
+				find(disableClientState, "glDisableClientState") && find(viewport, "glViewport");
+		}
+
+		template <typename Function>
+		static bool find(Function& function, const char* name) {
+			function = reinterpret_cast<Function>(sf::Context::getFunction(name));
+			return function != nullptr;
+		}
+	};
+
+	Functions gl;
+	sf::Shader shader;
+	unsigned int buffers[2] = { 0, 0 };	// The unit quad, then the instances
+};
+
+// Circle levels of detail by segment count. Level 0 draws a circle under a pixel across as a single
+// pixel sized quad. A level is good up to the projected radius where its outline strays circleLodError
+// pixels from the true circle, and a circle only leaves its level once the radius is circleLodHysteresis
+// past either end of that level's range, so a slow zoom does not make circles flicker between two levels
+const std::size_t circleLodSegments[] = { 0, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256 };
+const std::size_t circleLodCount = sizeof(circleLodSegments) / sizeof(circleLodSegments[0]);
+const float circleLodError = 0.25f;
+const float circleLodHysteresis = 0.2f;
+
+// Batched renderer, writes the triangles of every drawn shape into one vertex array so the whole scene
+// is submitted with a single draw call instead of one per shape. The array keeps a fixed range of
+// vertices per shape between frames: colours and outlines are only rewritten for dirty shapes, and only
+// a change in a shape's vertex count lays the ranges out again. Positions are rewritten every frame,
+// interpolated between ticks when the simulation runs at a different rate than the frames. When only
+// part of the world is on screen the array is instead rebuilt from just the visible shapes, so culled
+// shapes cost no vertices at all.
+// Tessellated circles use the fewest segments that look round at their size on screen, never more than
+// their own segment count.
+// With SDF circles enabled every circle is a single quad shaded on the GPU, so its segment count no
+// longer costs any vertices. Without shader support the tessellated path is used.
+// With instancing enabled no vertices are written at all, every drawn shape is one ShapeInstance drawn
+// by an InstancedShapeRenderer with SDF circles. The vertex batch stays the fallback for drivers
+// without instancing
+class ShapeBatchRenderer {
+public:
+	ShapeBatchRenderer() {
+		const float pi = 3.141592654f;
+		lodRadius[0] = 0.5f;
+		for (std::size_t level = 1; level < circleLodCount; ++level) {
+			lodRadius[level] = circleLodError / (1.0f - std::cos(pi / circleLodSegments[level]));
+		}
+		lodRadius[circleLodCount - 1] = std::numeric_limits<float>::max();
+	}
+
+	// Needs the window's OpenGL context, so it is called once the window exists. The shader is only
+	// created here, constructing an sf::Shader sets up an OpenGL context of its own, which aborts without
+	// a display, so a renderer that never loads it stays usable headless
+	bool loadShader() {
+		sdfAvailable = false;
+		if (sf::Shader::isAvailable()) {
+			sdfShader.reset(new sf::Shader());
+			sdfAvailable = sdfShader->loadFromMemory(sdfVertexShader, sdfFragmentShader);
+		}
+		if (!sdfAvailable) {
+			sdfShader.reset();
+		}
+		else {
+			instancer.reset(new InstancedShapeRenderer());
+			if (!instancer->load()) {
+				instancer.reset();
+			}
+		}
+		return sdfAvailable;
+	}
+
+	bool shaderAvailable() const {
+		return sdfAvailable;
+	}
+
+	bool sdfCirclesEnabled() const {
+		return sdfCircles;
+	}
+
+	void setSdfCircles(bool enabled) {
+		enabled = enabled && sdfAvailable;
+		if (enabled != sdfCircles) {
+			sdfCircles = enabled;
+			outlines.clear(); // Every circle changes its vertex count
+		}
+	}
+
+	bool instancingAvailable() const {
+		return instancer != nullptr;
+	}
+
+	bool instancingEnabled() const {
+		return instanced;
+	}
+
+	void setInstancing(bool enabled) {
+		enabled = enabled && instancer;
+		if (enabled != instanced) {
+			instanced = enabled;
+			outlines.clear(); // The vertex batch went stale while instances were drawn
+		}
+	}
+
+	bool circleLodEnabled() const {
+		return circleLod;
+	}
+
+	void setCircleLod(bool enabled) {
+		if (enabled != circleLod) {
+			circleLod = enabled;
+			outlines.clear();
+		}
+	}
+
+	// How many window pixels one world unit covers, which sets the circles' levels of detail
+	void setPixelsPerUnit(float scale) {
+		pixelsPerUnit = scale;
+	}
+
+	void build(ShapeStore& shapes, JobSystem& jobs) {
+		build(shapes, jobs, CurrentPositions(shapes));
+	}
+
+	void build(ShapeStore& shapes, JobSystem& jobs, const FramePositions& positions) {
+		if (instanced) {
+			buildInstances(shapes, jobs, positions, nullptr);
+			return;
+		}
+
+		bool relayout = shapes.size() != outlines.size() || culled;
+		if (relayout) {
+			outlines.assign(shapes.size(), nullptr);
+			lods.resize(shapes.size(), lodUnset);
+			firstVertex.assign(shapes.size() + 1, 0);
+			culled = false;
+		}
+
+		// A new scale can move any circle to another level
+		const bool rescaled = lodActive() && pixelsPerUnit != lodPixelsPerUnit;
+		if (relayout || shapes.hasDirty || rescaled) {
+			refreshDirty(shapes, relayout, rescaled);
+			shapes.clearDirty();
+			lodPixelsPerUnit = pixelsPerUnit;
+		}
+
+		jobs.parallelFor(shapes.size(), 4096, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i) {
+				if (firstVertex[i + 1] > firstVertex[i]) {
+					writePositions(shapes, positions, i, vertices.data() + firstVertex[i]);
+				}
+			}
+		});
+	}
+
+	// Builds only the shapes listed in visible, which must be in ascending order to keep the drawing order.
+	// Every vertex of a listed shape is written from scratch, and the fixed ranges are laid out again by
+	// the next full build. Only the listed circles have their level of detail brought up to date
+	void build(ShapeStore& shapes, JobSystem& jobs, const FramePositions& positions, const std::vector<std::uint32_t>& visible) {
+		if (instanced) {
+			buildInstances(shapes, jobs, positions, &visible);
+			return;
+		}
+
+		if (shapes.size() != outlines.size() || shapes.hasDirty) {
+			const bool resized = shapes.size() != outlines.size();
+			outlines.resize(shapes.size(), nullptr);
+			lods.resize(shapes.size(), lodUnset);
+			for (std::size_t i = 0; i < shapes.size(); ++i) {
+				if (resized || shapes.dirty[i]) {
+					refreshOutline(shapes, i, true);
+				}
+			}
+			shapes.clearDirty();
+		}
+		culled = true;
+		lodPixelsPerUnit = -1.0f;	// Circles out of view kept their old levels
+
+		const bool lodChanges = lodActive();
+		firstVertex.resize(std::max(firstVertex.size(), visible.size() + 1));
+		firstVertex[0] = 0;
+		for (std::size_t k = 0; k < visible.size(); ++k) {
+			if (lodChanges) {
+				refreshOutline(shapes, visible[k], false);
+			}
+			firstVertex[k + 1] = firstVertex[k] + vertexCountOf(shapes, visible[k]);
+		}
+		vertices.resize(firstVertex[visible.size()]);
+
+		jobs.parallelFor(visible.size(), 1024, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t k = begin; k < end; ++k) {
+				const std::uint32_t count = firstVertex[k + 1] - firstVertex[k];
+				if (count > 0) {
+					writeColours(shapes, visible[k], vertices.data() + firstVertex[k], count);
+					writePositions(shapes, positions, visible[k], vertices.data() + firstVertex[k]);
+				}
+			}
+		});
+	}
+
+	void draw(sf::RenderTarget& target) const {
+		if (instanced) {
+			instancer->draw(target, instances);
+		}
+		else if (!vertices.empty()) {
+			target.draw(vertices.data(), vertices.size(), sf::Triangles, sdfCircles ? sf::RenderStates(sdfShader.get()) : sf::RenderStates::Default);
+		}
+	}
+
+	std::size_t vertexCount() const {
+		return vertices.size();
+	}
+
+	std::size_t instanceCount() const {
+		return instances.size();
+	}
+
+private:
+	// Writes one instance per shape, or per listed visible shape. Every instance is written from scratch
+	// each frame, hidden shapes keep their place with a zero size so the instances stay in drawing order
+	void buildInstances(ShapeStore& shapes, JobSystem& jobs, const FramePositions& positions, const std::vector<std::uint32_t>* visible) {
+		if (shapes.hasDirty) {
+			shapes.clearDirty();
+		}
+
+		const std::size_t count = visible ? visible->size() : shapes.size();
+		instances.resize(count);
+		jobs.parallelFor(count, 4096, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t k = begin; k < end; ++k) {
+				writeInstance(shapes, positions, visible ? (*visible)[k] : k, instances[k]);
+			}
+		});
+	}
+
+	// Circles with under 3 segments are hidden as on the other paths
+	static void writeInstance(const ShapeStore& shapes, const FramePositions& positions, std::size_t i, ShapeInstance& instance) {
+		const bool circle = shapes.kinds[i] == ShapeKind::Circle;
+		const bool hidden = !shapes.drawn[i] || (circle && static_cast<std::size_t>(shapes.segments[i]) < 3);
+		instance.x = positions.previousX[i] + (positions.currentX[i] - positions.previousX[i]) * positions.alpha;
+		instance.y = positions.previousY[i] + (positions.currentY[i] - positions.previousY[i]) * positions.alpha;
+		instance.width = hidden ? 0.0f : shapes.width[i];
+		instance.height = hidden ? 0.0f : shapes.height[i];
+		instance.colour = sf::Color(static_cast<sf::Uint8>(shapes.r[i]), static_cast<sf::Uint8>(shapes.g[i]), static_cast<sf::Uint8>(shapes.b[i]));
+		instance.circle = circle ? 1.0f : 0.0f;
+	}
+
+	std::uint32_t vertexCountOf(const ShapeStore& shapes, std::size_t i) const {
+		if (!shapes.drawn[i]) {
+			return 0;
+		}
+		if (shapes.kinds[i] == ShapeKind::Circle) {
+			// Circles with under 3 segments have no outline and are hidden on either path
+			if (outlines[i]->empty()) {
+				return 0;
+			}
+			if (sdfCircles) {
+				return 6;
+			}
+			return lods[i] == 0 ? 6 : static_cast<std::uint32_t>(outlines[i]->size() - 1) * 3;
+		}
+		return 6;
+	}
+
+	bool lodActive() const {
+		return circleLod && !sdfCircles;
+	}
+
+	// The level for a circle of the given radius in pixels, staying at current while the radius is within
+	// the hysteresis margin of its range
+	std::uint8_t lodLevel(float pixelRadius, std::uint8_t current) const {
+		if (current != lodUnset) {
+			const float lower = current > 0 ? lodRadius[current - 1] * (1.0f - circleLodHysteresis) : 0.0f;
+			const float upper = lodRadius[current] * (1.0f + circleLodHysteresis);
+			if (pixelRadius >= lower && pixelRadius <= upper) {
+				return current;
+			}
+		}
+
+		std::size_t level = 0;
+		while (level + 1 < circleLodCount && lodRadius[level] < pixelRadius) {
+			++level;
+		}
+		return static_cast<std::uint8_t>(level);
+	}
+
+	// Brings shape i's level of detail up to date and looks up its outline if the level changed or force
+	// is set. The outline has the circle's own segment count where that is fewer than its level's
+	void refreshOutline(const ShapeStore& shapes, std::size_t i, bool force) {
+		if (shapes.kinds[i] != ShapeKind::Circle) {
+			outlines[i] = nullptr;
+			return;
+		}
+
+		const std::uint8_t level = lodActive() ? lodLevel(shapes.radius(i) * pixelsPerUnit, lods[i]) : lodUnset;
+		if (force || level != lods[i]) {
+			lods[i] = level;
+			const std::size_t segments = static_cast<std::size_t>(shapes.segments[i]);
+			outlines[i] = &tessellations.get(level == lodUnset || level == 0 ? segments : std::min(segments, circleLodSegments[level]));
+		}
+	}
+
+	void refreshDirty(const ShapeStore& shapes, bool relayout, bool rescaled) {
+		// Look up the outline of every changed circle and check the shape still fits in its vertex range
+		for (std::size_t i = 0; i < shapes.size(); ++i) {
+			if (relayout || shapes.dirty[i] || (rescaled && shapes.kinds[i] == ShapeKind::Circle)) {
+				refreshOutline(shapes, i, relayout || shapes.dirty[i]);
+				relayout = relayout || vertexCountOf(shapes, i) != firstVertex[i + 1] - firstVertex[i];
+			}
+		}
+
+		if (relayout) {
+			for (std::size_t i = 0; i < shapes.size(); ++i) {
+				firstVertex[i + 1] = firstVertex[i] + vertexCountOf(shapes, i);
+			}
+			vertices.resize(firstVertex.back());
+		}
+
+		// Moving the ranges leaves every vertex with a stale colour, otherwise only dirty shapes need one
+		for (std::size_t i = 0; i < shapes.size(); ++i) {
+			if ((relayout || shapes.dirty[i]) && firstVertex[i + 1] > firstVertex[i]) {
+				writeColours(shapes, i, vertices.data() + firstVertex[i], firstVertex[i + 1] - firstVertex[i]);
+			}
+		}
+	}
+
+	// Writes the colour and texture coordinates of the count vertices of shape i
+	void writeColours(const ShapeStore& shapes, std::size_t i, sf::Vertex* vertex, std::uint32_t count) const {
+		const sf::Color colour(static_cast<sf::Uint8>(shapes.r[i]), static_cast<sf::Uint8>(shapes.g[i]), static_cast<sf::Uint8>(shapes.b[i]));
+		for (std::uint32_t v = 0; v < count; ++v) {
+			vertex[v].color = colour;
+			vertex[v].texCoords = sf::Vector2f(0.0f, 0.0f);
+		}
+
+		if (sdfCircles && shapes.kinds[i] == ShapeKind::Circle) {
+			writeQuad(vertex, sf::Vector2f(-1.0f, -1.0f), sf::Vector2f(1.0f, 1.0f), &sf::Vertex::texCoords);
+		}
+	}
+
+	// Circles follow the sf::CircleShape outline, the first point at the top and positioned by the bounding
+	// box corner. The cached unit outline is only scaled and offset, so no trigonometry runs per frame.
+	// Circles under a pixel across become a quad of one pixel around their centre
+	void writePositions(const ShapeStore& shapes, const FramePositions& positions, std::size_t i, sf::Vertex* vertex) const {
+		const float x = positions.previousX[i] + (positions.currentX[i] - positions.previousX[i]) * positions.alpha;
+		const float y = positions.previousY[i] + (positions.currentY[i] - positions.previousY[i]) * positions.alpha;
+		if (shapes.kinds[i] == ShapeKind::Circle && !sdfCircles) {
+			const std::vector<sf::Vector2f>& outline = *outlines[i];
+			const float radius = shapes.radius(i);
+			const sf::Vector2f centre(x + radius, y + radius);
+			if (lods[i] == 0) {
+				const float half = 0.5f / pixelsPerUnit;
+				writeQuad(vertex, centre - sf::Vector2f(half, half), centre + sf::Vector2f(half, half), &sf::Vertex::position);
+				return;
+			}
+			for (std::size_t s = 1; s < outline.size(); ++s) {
+				(vertex++)->position = centre;
+				(vertex++)->position = centre + outline[s - 1] * radius;
+				(vertex++)->position = centre + outline[s] * radius;
+			}
+		}
+		else {
+			writeQuad(vertex, sf::Vector2f(x, y), sf::Vector2f(x + shapes.width[i], y + shapes.height[i]), &sf::Vertex::position);
+		}
+	}
+
+	// Writes the two triangles of an axis aligned quad into one vertex field, position or texCoords
+	static void writeQuad(sf::Vertex* vertex, const sf::Vector2f& min, const sf::Vector2f& max, sf::Vector2f sf::Vertex::* field) {
+		vertex[0].*field = min;
+		vertex[1].*field = sf::Vector2f(max.x, min.y);
+		vertex[2].*field = max;
+		vertex[3].*field = min;
+		vertex[4].*field = max;
+		vertex[5].*field = sf::Vector2f(min.x, max.y);
+	}
+
+	std::vector<sf::Vertex> vertices;
+	std::vector<std::uint32_t> firstVertex;					// Shape i owns vertices [firstVertex[i], firstVertex[i + 1]), or the i-th visible one after a culled build
+	std::vector<const std::vector<sf::Vector2f>*> outlines;	// Cached unit outline per circle, null for rectangles
+	TessellationCache tessellations;
+	bool culled = false;									// The last build only wrote the visible shapes
+
+	static constexpr std::uint8_t lodUnset = 0xFF;		// Drawn at the circle's own segment count
+	std::vector<std::uint8_t> lods;						// Level of detail per circle
+	float lodRadius[circleLodCount];					// Largest radius in pixels each level is used for
+	float pixelsPerUnit = 1.0f;
+	float lodPixelsPerUnit = -1.0f;						// The scale every circle's level was last chosen at
+	bool circleLod = true;
+
+	std::unique_ptr<sf::Shader> sdfShader;				// Null until loadShader succeeds
+	bool sdfAvailable = false;
+	bool sdfCircles = false;
+
+	std::unique_ptr<InstancedShapeRenderer> instancer;	// Null unless loadShader found instancing
+	std::vector<ShapeInstance> instances;
+	bool instanced = false;
+};
+
+// --------------------------------------------------------------------------
+
+// Pannable, zoomable view onto the world. Zoom is in world units per window pixel, so at 1 the world is
+// shown at its natural size. The mouse wheel zooms about the cursor, dragging with the right or middle
+// button or holding the arrow keys pans, and Home fits the whole world in the window
+class Camera {
+public:
+	// Shows the world from its top left corner at zoom 1, as the window did before it had a camera
+	void reset(const sf::Vector2u& windowSize, const sf::Vector2u& worldSize) {
+		window = sf::Vector2f(static_cast<float>(windowSize.x), static_cast<float>(windowSize.y));
+		world = sf::Vector2f(static_cast<float>(worldSize.x), static_cast<float>(worldSize.y));
+		zoom = 1.0f;
+		centre = window * 0.5f;
+	}
+
+	void fit() {
+		zoom = clampZoom(std::max(world.x / std::max(window.x, 1.0f), world.y / std::max(window.y, 1.0f)));
+		centre = world * 0.5f;
+	}
+
+	void setWorldSize(const sf::Vector2u& worldSize) {
+		world = sf::Vector2f(static_cast<float>(worldSize.x), static_cast<float>(worldSize.y));
+		clampCentre();
+	}
+
+	// Returns true if the event moved the camera. Mouse and keyboard events ImGui wants are left alone
+	bool handleEvent(const sf::Event& event, bool mouseCaptured, bool keyboardCaptured) {
+		switch (event.type) {
+		case sf::Event::Resized:
+			window = sf::Vector2f(static_cast<float>(event.size.width), static_cast<float>(event.size.height));
+			return true;
+		case sf::Event::MouseWheelScrolled:
+			if (mouseCaptured) {
+				return false;
+			}
+			zoomAt(sf::Vector2i(event.mouseWheelScroll.x, event.mouseWheelScroll.y), std::pow(0.85f, event.mouseWheelScroll.delta));
+			return true;
+		case sf::Event::MouseButtonPressed:
+			if (mouseCaptured || (event.mouseButton.button != sf::Mouse::Right && event.mouseButton.button != sf::Mouse::Middle)) {
+				return false;
+			}
+			dragging = true;
+			dragFrom = sf::Vector2i(event.mouseButton.x, event.mouseButton.y);
+			return false;
+		case sf::Event::MouseButtonReleased:
+			if (event.mouseButton.button == sf::Mouse::Right || event.mouseButton.button == sf::Mouse::Middle) {
+				dragging = false;
+			}
+			return false;
+		case sf::Event::MouseMoved:
+			if (!dragging) {
+				return false;
+			}
+			pan(sf::Vector2f(static_cast<float>(dragFrom.x - event.mouseMove.x), static_cast<float>(dragFrom.y - event.mouseMove.y)));
+			dragFrom = sf::Vector2i(event.mouseMove.x, event.mouseMove.y);
+			return true;
+		case sf::Event::KeyPressed:
+			if (keyboardCaptured || event.key.code != sf::Keyboard::Home) {
+				return false;
+			}
+			fit();
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Pans with the arrow keys held down, at a speed in window pixels so it feels the same at every zoom
+	void update(float seconds, bool keyboardCaptured) {
+		if (keyboardCaptured) {
+			return;
+		}
+		const float speed = 800.0f * seconds;
+		sf::Vector2f move;
+		move.x = (sf::Keyboard::isKeyPressed(sf::Keyboard::Right) ? speed : 0.0f) - (sf::Keyboard::isKeyPressed(sf::Keyboard::Left) ? speed : 0.0f);
+		move.y = (sf::Keyboard::isKeyPressed(sf::Keyboard::Down) ? speed : 0.0f) - (sf::Keyboard::isKeyPressed(sf::Keyboard::Up) ? speed : 0.0f);
+		if (move.x != 0.0f || move.y != 0.0f) {
+			pan(move);
+		}
+	}
+
+	// Moves by a distance in window pixels
+	void pan(const sf::Vector2f& pixels) {
+		centre += pixels * zoom;
+		clampCentre();
+	}
+
+	// Scales the zoom by factor, keeping the world point under the pixel in place
+	void zoomAt(const sf::Vector2i& pixel, float factor) {
+		const sf::Vector2f offset(static_cast<float>(pixel.x) - window.x * 0.5f, static_cast<float>(pixel.y) - window.y * 0.5f);
+		const sf::Vector2f anchor = centre + offset * zoom;
+		zoom = clampZoom(zoom * factor);
+		centre = anchor - offset * zoom;
+		clampCentre();
+	}
+
+	sf::View view() const {
+		return sf::View(centre, window * zoom);
+	}
+
+	// The part of the world the window shows
+	sf::FloatRect area() const {
+		const sf::Vector2f size = window * zoom;
+		return sf::FloatRect(centre.x - size.x * 0.5f, centre.y - size.y * 0.5f, size.x, size.y);
+	}
+
+	// True when nothing in the world is outside the window
+	bool showsWholeWorld() const {
+		const sf::FloatRect shown = area();
+		return shown.left <= 0.0f && shown.top <= 0.0f && shown.left + shown.width >= world.x && shown.top + shown.height >= world.y;
+	}
+
+	float zoomLevel() const {
+		return zoom;
+	}
+
+private:
+	// From 64 pixels per world unit out to a quarter of the fitted world
+	float clampZoom(float value) const {
+		const float fitted = std::max(world.x / std::max(window.x, 1.0f), world.y / std::max(window.y, 1.0f));
+		return std::min(std::max(value, 1.0f / 64.0f), std::max(fitted * 4.0f, 1.0f));
+	}
+
+	// Keeps the centre over the world so it cannot be lost off the edge
+	void clampCentre() {
+		centre.x = std::min(std::max(centre.x, 0.0f), world.x);
+		centre.y = std::min(std::max(centre.y, 0.0f), world.y);
+	}
+
+	sf::Vector2f window;
+	sf::Vector2f world;
+	sf::Vector2f centre;
+	float zoom = 1.0f;
+	bool dragging = false;
+	sf::Vector2i dragFrom;
+};
+
+// The drawn shapes whose bounding box overlaps area, with x and y the positions the index was last updated
+// with. Visible ends up in ascending order so shapes overlap the same way as without culling. A few
+// candidates are sorted, many are ticked off in marks and gathered with one pass over it, which is cheaper
+// than sorting them
+void CollectVisibleShapes(const SpatialIndex& index, const ShapeStore& shapes, const float* x, const float* y, const sf::FloatRect& area,
+	std::vector<std::uint8_t>& marks, std::vector<std::uint32_t>& visible) {
+	const float left = area.left, top = area.top, right = area.left + area.width, bottom = area.top + area.height;
+	visible.clear();
+	index.query(left, top, right, bottom, [&](std::uint32_t i) {
+		if (x[i] <= right && y[i] <= bottom && x[i] + shapes.width[i] >= left && y[i] + shapes.height[i] >= top) {
+			visible.push_back(i);
+		}
+	});
+
+	if (visible.size() < shapes.size() / 32) {
+		std::sort(visible.begin(), visible.end());
+		return;
+	}
+
+	marks.assign(shapes.size(), 0);
+	for (std::uint32_t i : visible) {
+		marks[i] = 1;
+	}
+	visible.clear();
+	for (std::size_t i = 0; i < marks.size(); ++i) {
+		if (marks[i]) {
+			visible.push_back(static_cast<std::uint32_t>(i));
+		}
+	}
+}
+
+// --------------------------------------------------------------------------
+
+// Name lookups for the Debug Panel's shape browser. A hash table of shape indices finds an exact name
+// in constant time, and the indices sorted by name turn a prefix search into a binary search for a
+// contiguous range. Both only hold indices and read the names from the store when comparing
+class ShapeNameIndex {
+public:
+	static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+	// Adds the shapes appended to the store since the last call
+	void update(const ShapeStore& shapes) {
+		const std::size_t first = sorted.size();
+		if (first == shapes.size()) {
+			return;
+		}
+
+		// Sort the new shapes on their own and merge them in, rather than sorting everything again
+		for (std::size_t i = first; i < shapes.size(); ++i) {
+			sorted.push_back(static_cast<std::uint32_t>(i));
+		}
+		const auto byName = [&](std::uint32_t a, std::uint32_t b) {
+			return shapes.name(a) < shapes.name(b);
+		};
+		std::stable_sort(sorted.begin() + first, sorted.end(), byName);
+		std::inplace_merge(sorted.begin(), sorted.begin() + first, sorted.end(), byName);
+
+		// Keep the table at most half full
+		if (table.size() < shapes.size() * 2) {
+			std::size_t capacity = 64;
+			while (capacity < shapes.size() * 2) {
+				capacity *= 2;
+			}
+			table.assign(capacity, empty);
+			for (std::size_t i = 0; i < first; ++i) {
+				insert(shapes, i);
+			}
+		}
+		for (std::size_t i = first; i < shapes.size(); ++i) {
+			insert(shapes, i);
+		}
+	}
+
+	// The first shape with exactly this name, or npos
+	std::size_t find(const ShapeStore& shapes, std::string_view name) const {
+		if (table.empty()) {
+			return npos;
+		}
+		for (std::size_t slot = Hash(name) & (table.size() - 1); table[slot] != empty; slot = (slot + 1) & (table.size() - 1)) {
+			if (shapes.name(table[slot]) == name) {
+				return table[slot];
+			}
+		}
+		return npos;
+	}
+
+	// Positions [first, last) in name order of the shapes whose name starts with prefix
+	std::pair<std::size_t, std::size_t> prefixRange(const ShapeStore& shapes, std::string_view prefix) const {
+		const auto first = std::lower_bound(sorted.begin(), sorted.end(), prefix, [&](std::uint32_t i, std::string_view value) {
+			return shapes.name(i) < value;
+		});
+		const auto last = std::upper_bound(first, sorted.end(), prefix, [&](std::string_view value, std::uint32_t i) {
+			return value < shapes.name(i).substr(0, value.size());
+		});
+		return { static_cast<std::size_t>(first - sorted.begin()), static_cast<std::size_t>(last - sorted.begin()) };
+	}
+
+	// Shape at a position in name order
+	std::size_t byName(std::size_t position) const {
+		return sorted[position];
+	}
+
+private:
+	static constexpr std::uint32_t empty = 0xFFFFFFFFu;
+
+	// FNV-1a
+	static std::size_t Hash(std::string_view name) {
+		std::uint64_t hash = 14695981039346656037ull;
+		for (char c : name) {
+			hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+		}
+		return static_cast<std::size_t>(hash ^ (hash >> 32));
+	}
+
+	// Linear probing. A name already in the table keeps its first shape
+	void insert(const ShapeStore& shapes, std::size_t i) {
+		const std::string_view name = shapes.name(i);
+		std::size_t slot = Hash(name) & (table.size() - 1);
+		while (table[slot] != empty) {
+			if (shapes.name(table[slot]) == name) {
+				return;
+			}
+			slot = (slot + 1) & (table.size() - 1);
+		}
+		table[slot] = static_cast<std::uint32_t>(i);
+	}
+
+	std::vector<std::uint32_t> sorted;	// Every shape index, ordered by name
+	std::vector<std::uint32_t> table;	// Shape indices by name hash, a power of two long
+};
+
+// Criteria for selecting many shapes at once, a shape is selected when every enabled one matches
+struct SelectionFilter {
+	bool byName = false;			// Name starts with the search box text
+	int kind = 0;					// 0 any kind, 1 circles, 2 rectangles
+	bool byColour = false;
+	float colourMin[3] = { 0.0f, 0.0f, 0.0f };
+	float colourMax[3] = { 255.0f, 255.0f, 255.0f };
+	bool byArea = false;			// Bounding box overlaps the area
+	float area[4] = { 0.0f, 0.0f, 640.0f, 360.0f };	// Left, top, right, bottom
+};
+
+// Returns the indices of the matching shapes in increasing order
+std::vector<std::uint32_t> SelectShapes(const ShapeStore& shapes, const ShapeNameIndex& names, std::string_view prefix, const SelectionFilter& filter) {
+	// Start from the smallest set the name or kind already narrows it down to
+	std::vector<std::uint32_t> candidates;
+	if (filter.byName) {
+		const std::pair<std::size_t, std::size_t> range = names.prefixRange(shapes, prefix);
+		for (std::size_t position = range.first; position < range.second; ++position) {
+			candidates.push_back(static_cast<std::uint32_t>(names.byName(position)));
+		}
+		std::sort(candidates.begin(), candidates.end());
+	}
+	else if (filter.kind != 0) {
+		candidates = filter.kind == 1 ? shapes.circles : shapes.rectangles;
+	}
+	else {
+		candidates.resize(shapes.size());
+		for (std::size_t i = 0; i < shapes.size(); ++i) {
+			candidates[i] = static_cast<std::uint32_t>(i);
+		}
+	}
+
+	const ShapeKind kind = filter.kind == 1 ? ShapeKind::Circle : ShapeKind::Rectangle;
+	std::vector<std::uint32_t> selection;
+	for (std::uint32_t i : candidates) {
+		if (filter.kind != 0 && shapes.kinds[i] != kind) {
+			continue;
+		}
+		if (filter.byColour &&
+			(shapes.r[i] < filter.colourMin[0] || shapes.r[i] > filter.colourMax[0] ||
+			 shapes.g[i] < filter.colourMin[1] || shapes.g[i] > filter.colourMax[1] ||
+			 shapes.b[i] < filter.colourMin[2] || shapes.b[i] > filter.colourMax[2])) {
+			continue;
+		}
+		if (filter.byArea &&
+			(shapes.posX[i] > filter.area[2] || shapes.posX[i] + shapes.width[i] < filter.area[0] ||
+			 shapes.posY[i] > filter.area[3] || shapes.posY[i] + shapes.height[i] < filter.area[1])) {
+			continue;
+		}
+		selection.push_back(i);
+	}
+	return selection;
+}
+
+// Changes made to every selected shape at once, only the enabled ones are applied
+struct BulkEdit {
+	bool setSpeed = false;
+	float speed[2] = { 0.0f, 0.0f };
+	bool scaleSize = false;
+	float sizeScale = 1.0f;			// Circles keep their diameter in both width and height, so both scale
+	bool setColour = false;
+	float colour[3] = { 255.0f, 255.0f, 255.0f };
+	bool setDrawn = false;
+	bool drawn = true;
+};
+
+// One tight loop over the selection per changed field, rather than a round trip through the UI per shape
+void ApplyBulkEdit(ShapeStore& shapes, const std::vector<std::uint32_t>& selection, const BulkEdit& edit) {
+	if (edit.setSpeed) {
+		for (std::uint32_t i : selection) {
+			shapes.speedX[i] = edit.speed[0];
+			shapes.speedY[i] = edit.speed[1];
+		}
+	}
+	if (edit.scaleSize) {
+		const float scale = std::max(edit.sizeScale, 0.0f);
+		for (std::uint32_t i : selection) {
+			shapes.width[i] *= scale;
+			shapes.height[i] *= scale;
+		}
+	}
+	if (edit.setColour) {
+		for (std::uint32_t i : selection) {
+			shapes.r[i] = edit.colour[0];
+			shapes.g[i] = edit.colour[1];
+			shapes.b[i] = edit.colour[2];
+		}
+	}
+	if (edit.setDrawn) {
+		for (std::uint32_t i : selection) {
+			shapes.drawn[i] = edit.drawn;
+		}
+	}
+
+	// Speeds are read every frame anyway, anything else needs the renderer to refresh the shapes
+	if (edit.scaleSize || edit.setColour || edit.setDrawn) {
+		for (std::uint32_t i : selection) {
+			shapes.dirty[i] = 1;
+		}
+		shapes.hasDirty = shapes.hasDirty || !selection.empty();
+	}
+}
+
+// State the Debug Panel keeps between frames
+struct DebugPanelState {
+	ShapeNameIndex names;
+	char search[128] = "";			// Name prefix the shape list is filtered by
+	int page = 0;					// Page of the shape list on screen
+	int selectedShapeIndex = 0;
+	bool scrollToSelected = false;	// Set when a shape is picked in the window, the list shows it next frame
+
+	// Shapes picked for bulk edits, in increasing order, and how they were picked
+	std::vector<std::uint32_t> selection;
+	SelectionFilter filter;
+	BulkEdit bulkEdit;
+};
+
+DebugPanelState CreateDebugPanelState(const ShapeStore& shapes) {
+	DebugPanelState panel;
+	panel.names.update(shapes);
+	return panel;
+}
+
+// Search box and list of the matching shapes. Only the rows in view are submitted to ImGui, and long
+// lists are split into pages so scrolling stays precise with a million shapes
+void BuildShapeBrowser(DebugPanelState& panel, const ShapeStore& shapes) {
+	const std::size_t pageSize = 10000;
+
+	const bool entered = ImGui::InputTextWithHint("Search", "Name or start of a name", panel.search, sizeof(panel.search), ImGuiInputTextFlags_EnterReturnsTrue);
+	if (ImGui::IsItemEdited()) {
+		panel.page = 0;
+	}
+
+	// Without a search every shape is listed in configuration order, otherwise the matches by name
+	const std::string_view query(panel.search);
+	std::pair<std::size_t, std::size_t> range(0, shapes.size());
+	if (!query.empty()) {
+		range = panel.names.prefixRange(shapes, query);
+	}
+	const std::size_t matches = range.second - range.first;
+	const auto shapeAt = [&](std::size_t row) {
+		return query.empty() ? row : panel.names.byName(range.first + row);
+	};
+
+	// Enter selects the shape with exactly that name, or the first match
+	if (entered && matches > 0) {
+		const std::size_t exact = panel.names.find(shapes, query);
+		panel.selectedShapeIndex = static_cast<int>(exact != ShapeNameIndex::npos ? exact : shapeAt(0));
+	}
+
+	const int pageCount = static_cast<int>(std::max<std::size_t>((matches + pageSize - 1) / pageSize, 1));
+	panel.page = std::min(std::max(panel.page, 0), pageCount - 1);
+	ImGui::Text("%zu of %zu shapes", matches, shapes.size());
+	if (pageCount > 1) {
+		ImGui::SameLine();
+		if (ImGui::ArrowButton("##PreviousPage", ImGuiDir_Left)) {
+			--panel.page;
+		}
+		ImGui::SameLine();
+		ImGui::Text("Page %d of %d", panel.page + 1, pageCount);
+		ImGui::SameLine();
+		if (ImGui::ArrowButton("##NextPage", ImGuiDir_Right)) {
+			++panel.page;
+		}
+		panel.page = std::min(std::max(panel.page, 0), pageCount - 1);
+	}
+
+	// A shape picked in the window is brought into view, when the list is in configuration order
+	if (panel.scrollToSelected && query.empty()) {
+		panel.page = static_cast<int>(panel.selectedShapeIndex / pageSize);
+	}
+
+	const std::size_t pageFirst = static_cast<std::size_t>(panel.page) * pageSize;
+	const std::size_t pageRows = std::min(pageSize, matches - std::min(matches, pageFirst));
+	ImGui::BeginChild("##ShapeList", ImVec2(0.0f, ImGui::GetTextLineHeightWithSpacing() * 8.0f), ImGuiChildFlags_Border);
+	if (panel.scrollToSelected && query.empty()) {
+		ImGui::SetScrollY((panel.selectedShapeIndex - pageFirst) * ImGui::GetTextLineHeightWithSpacing());
+	}
+	panel.scrollToSelected = false;
+	ImGuiListClipper clipper;
+	clipper.Begin(static_cast<int>(pageRows));
+	while (clipper.Step()) {
+		for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+			const std::size_t i = shapeAt(pageFirst + row);
+			const std::uint32_t index = static_cast<std::uint32_t>(i);
+			const auto member = std::lower_bound(panel.selection.begin(), panel.selection.end(), index);
+			const bool inSelection = member != panel.selection.end() && *member == index;
+
+			// Ctrl+click adds a shape to the bulk edit selection or takes it out
+			ImGui::PushID(static_cast<int>(i));
+			if (ImGui::Selectable(shapes.nameCStr(i), panel.selectedShapeIndex == static_cast<int>(i) || inSelection)) {
+				if (ImGui::GetIO().KeyCtrl) {
+					if (inSelection) {
+						panel.selection.erase(member);
+					}
+					else {
+						panel.selection.insert(member, index);
+					}
+				}
+				panel.selectedShapeIndex = static_cast<int>(i);
+			}
+			ImGui::PopID();
+		}
+	}
+	ImGui::EndChild();
+}
+
+// Picks many shapes by name, kind, colour or area and edits them together
+void BuildBulkEditor(DebugPanelState& panel, ShapeStore& shapes) {
+	SelectionFilter& filter = panel.filter;
+	ImGui::Checkbox("Name starts with the search", &filter.byName);
+	ImGui::Combo("Kind", &filter.kind, "Any\0Circles\0Rectangles\0");
+	ImGui::Checkbox("Colour between", &filter.byColour);
+	if (filter.byColour) {
+		ImGui::DragFloat3("Lowest##ColourMin", filter.colourMin, 1.0f, 0.0f, 255.0f, "%.0f");
+		ImGui::DragFloat3("Highest##ColourMax", filter.colourMax, 1.0f, 0.0f, 255.0f, "%.0f");
+	}
+	ImGui::Checkbox("Inside area", &filter.byArea);
+	if (filter.byArea) {
+		ImGui::DragFloat4("Left, top, right, bottom", filter.area, 1.0f);
+	}
+
+	if (ImGui::Button("Select")) {
+		panel.selection = SelectShapes(shapes, panel.names, panel.search, filter);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Add to selection")) {
+		const std::vector<std::uint32_t> added = SelectShapes(shapes, panel.names, panel.search, filter);
+		std::vector<std::uint32_t> merged;
+		merged.reserve(panel.selection.size() + added.size());
+		std::set_union(panel.selection.begin(), panel.selection.end(), added.begin(), added.end(), std::back_inserter(merged));
+		panel.selection.swap(merged);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Clear")) {
+		panel.selection.clear();
+	}
+	ImGui::Text("%zu shapes selected, Ctrl+click in the list to add or remove one", panel.selection.size());
+
+	BulkEdit& edit = panel.bulkEdit;
+	ImGui::Checkbox("##SetSpeed", &edit.setSpeed);
+	ImGui::SameLine();
+	ImGui::SliderFloat2("Speed##BulkSpeed", edit.speed, -5.0f, 5.0f);
+	ImGui::Checkbox("##ScaleSize", &edit.scaleSize);
+	ImGui::SameLine();
+	ImGui::SliderFloat("Size scale", &edit.sizeScale, 0.0f, 4.0f);
+	ImGui::Checkbox("##SetColour", &edit.setColour);
+	ImGui::SameLine();
+	ImGui::DragFloat3("Colour##BulkColour", edit.colour, 1.0f, 0.0f, 255.0f, "%.0f");
+	ImGui::Checkbox("##SetDrawn", &edit.setDrawn);
+	ImGui::SameLine();
+	ImGui::Checkbox("Draw##BulkDrawn", &edit.drawn);
+
+	ImGui::BeginDisabled(panel.selection.empty());
+	if (ImGui::Button("Apply ticked changes to the selection")) {
+		ApplyBulkEdit(shapes, panel.selection, edit);
+	}
+	ImGui::EndDisabled();
+}
+
+// Creates a window called "Debug Panel" and uses it to display the ImGui widgets, between NewFrame and Render
+void BuildDebugPanel(DebugPanelState& panel, ShapeStore& shapes, ShapeBatchRenderer& renderer, CollisionSystem& collisions) {
+	ImGui::Begin("Debug Panel");
+	ImGui::Text("Parameters of shapes");
+
+	// Index the names of shapes added since the last frame
+	panel.names.update(shapes);
+
+	if (shapes.size() > 0) {
+		BuildShapeBrowser(panel, shapes);
+
+		// Display and modify parameters of the selected shape
+		const std::size_t i = static_cast<std::size_t>(panel.selectedShapeIndex);
+		bool changed = false;	// Any edit marks the shape dirty so the renderer refreshes it
+
+		bool shapeDrawn = shapes.drawn[i] != 0;
+		if (ImGui::Checkbox((std::string("Draw ") + shapes.nameCStr(i)).c_str(), &shapeDrawn)) {
+			shapes.drawn[i] = shapeDrawn;
+			changed = true;
+		}
+
+		// Check if the selected shape is a Circle
+		if (shapes.kinds[i] == ShapeKind::Circle) {
+			float radius = shapes.radius(i);
+			if (ImGui::SliderFloat("Size##Radius", &radius, 0.0f, 255.0f)) {
+				shapes.width[i] = shapes.height[i] = radius * 2;
+				changed = true;
+			}
+			changed |= ImGui::SliderFloat("Segments##Segments", &shapes.segments[i], 0.0f, 64.0f);
+		}
+		// Otherwise it is a Rectangle
+		else {
+			// Set a custom width for the sliders
+			ImGui::PushItemWidth(237.0f); // Adjust the width as needed
+
+			changed |= ImGui::SliderFloat("##Width", &shapes.width[i], 0.0f, 200.0f);
+			ImGui::SameLine();
+			changed |= ImGui::SliderFloat("Size##Height", &shapes.height[i], 0.0f, 200.0f);
+
+			// Restore the default item width
+			ImGui::PopItemWidth();
+		}
+
+		// Set a custom width for the sliders
+		ImGui::PushItemWidth(237.0f); // Adjust the width as needed
+
+		changed |= ImGui::SliderFloat("##SpeedX", &shapes.speedX[i], -5.0f, 5.0f);
+		ImGui::SameLine();
+		changed |= ImGui::SliderFloat("Speed##SpeedY", &shapes.speedY[i], -5.0f, 5.0f);
+
+		// Restore the default item width
+		ImGui::PopItemWidth();
+
+		// For colour ------------------------------
+		// Set a custom width for the sliders
+		ImGui::PushItemWidth(155.0f); // Adjust the width as needed
+
+		changed |= ImGui::SliderFloat("##Red", &shapes.r[i], 0.0f, 255.0f);
+		ImGui::SameLine();
+		changed |= ImGui::SliderFloat("##Green", &shapes.g[i], 0.0f, 255.0f);
+		ImGui::SameLine();
+		changed |= ImGui::SliderFloat("Colour##Blue", &shapes.b[i], 0.0f, 255.0f);
+
+		// Restore the default item width
+		ImGui::PopItemWidth();
+
+		if (changed) {
+			shapes.markDirty(i);
+		}
+
+		// Bulk edits ------------------------------
+		if (ImGui::CollapsingHeader("Multi-selection")) {
+			BuildBulkEditor(panel, shapes);
+		}
+	}
+
+	// Renderer options ------------------------------
+	ImGui::Separator();
+	bool instancing = renderer.instancingEnabled();
+	if (renderer.instancingAvailable() && ImGui::Checkbox("GPU instancing", &instancing)) {
+		renderer.setInstancing(instancing);
+	}
+	bool sdfCircles = renderer.sdfCirclesEnabled();
+	if (!renderer.shaderAvailable()) {
+		ImGui::TextDisabled("Shaders unavailable, circles are tessellated");
+	}
+	else if (!renderer.instancingEnabled() && ImGui::Checkbox("SDF circles", &sdfCircles)) {
+		renderer.setSdfCircles(sdfCircles);
+	}
+	bool circleLod = renderer.circleLodEnabled();
+	if (renderer.instancingEnabled()) {
+		ImGui::Text("Instances: %zu", renderer.instanceCount());
+	}
+	else {
+		if (!renderer.sdfCirclesEnabled() && ImGui::Checkbox("Circle level of detail", &circleLod)) {
+			renderer.setCircleLod(circleLod);
+		}
+		ImGui::Text("Vertices: %zu", renderer.vertexCount());
+	}
+
+	// Simulation options ------------------------------
+	ImGui::Separator();
+	ImGui::Checkbox("Shape collisions", &collisions.enabled);
+	ImGui::Text("Contacts: %zu", collisions.contactCount());
+
+	ImGui::End();
+}
+
+// Appends the camera controls to the Debug Panel. visibleShapes is how many shapes survived culling
+void BuildCameraPanel(Camera& camera, bool& culling, std::size_t visibleShapes, std::size_t shapeCount) {
+	ImGui::Begin("Debug Panel");
+	if (ImGui::CollapsingHeader("Camera")) {
+		const sf::FloatRect area = camera.area();
+		ImGui::Text("Zoom: %.3f units per pixel", camera.zoomLevel());
+		ImGui::Text("Showing %.0f, %.0f to %.0f, %.0f", area.left, area.top, area.left + area.width, area.top + area.height);
+		if (ImGui::Button("Fit world (Home)")) {
+			camera.fit();
+		}
+		ImGui::Checkbox("Cull off-screen shapes", &culling);
+		ImGui::Text("Visible shapes: %zu of %zu", visibleShapes, shapeCount);
+		ImGui::TextDisabled("Wheel zooms, right drag or arrow keys pan");
+	}
+	ImGui::End();
+}
+
+// --------------------------------------------------------------------------
+
+// Name of the zone around a whole iteration of the main loop, the profiler view lays out its timeline by it
+const char* const frameZoneName = "Frame";
+
+// Profiler section of the Debug Panel: per-zone statistics over the last samples and a timeline of a
+// whole frame, one row per thread and nesting depth
+class ProfilerView {
+public:
+	// Takes in the events recorded since the last call, unless frozen
+	void update() {
+		if (frozen) {
+			return;
+		}
+
+		incoming.clear();
+		Profiler().read(nextEvent, incoming);
+		for (const ProfileEvent& event : incoming) {
+			history(event.zone).add((event.end - event.start) * 1e-6f);
+			pending[event.frame].push_back(event);
+
+			// The simulation ticks started in a frame finish during the next one, so a frame's timeline is
+			// only complete once the frame after it has ended
+			if (event.zone == frameZoneName && event.frame > 0) {
+				completeFrame(event.frame - 1);
+			}
+		}
+	}
+
+	void build() {
+		ImGui::Checkbox("Freeze", &frozen);
+		ImGui::SameLine();
+		if (ImGui::Checkbox("Hold slowest frame", &holdSlowest)) {
+			slowest = Timeline();
+		}
+
+		if (ImGui::BeginTable("##ProfilerZones", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp)) {
+			ImGui::TableSetupColumn("Zone");
+			for (const char* column : { "Avg ms", "p50", "p95", "p99", "Max" }) {
+				ImGui::TableSetupColumn(column);
+			}
+			ImGui::TableHeadersRow();
+
+			for (const auto& zone : zones) {
+				sorted.assign(zone.second.samples.begin(), zone.second.samples.end());
+				std::sort(sorted.begin(), sorted.end());
+				float sum = 0.0f;
+				for (float sample : sorted) {
+					sum += sample;
+				}
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(zone.first);
+				for (float value : { sum / sorted.size(), percentile(0.50f), percentile(0.95f), percentile(0.99f), sorted.back() }) {
+					ImGui::TableNextColumn();
+					ImGui::Text("%.3f", value);
+				}
+			}
+			ImGui::EndTable();
+		}
+
+		const Timeline& shown = holdSlowest && !slowest.events.empty() ? slowest : latest;
+		if (!shown.events.empty()) {
+			ImGui::Text("Frame %llu: %.3f ms", static_cast<unsigned long long>(shown.frame), shown.frameLength * 1e-6f);
+			drawTimeline(shown);
+		}
+	}
+
+private:
+	// The most recent durations of one zone, in milliseconds
+	struct ZoneHistory {
+		static const std::size_t length = 240;
+		std::vector<float> samples;
+		std::size_t next = 0;
+
+		void add(float milliseconds) {
+			if (samples.size() < length) {
+				samples.push_back(milliseconds);
+			}
+			else {
+				samples[next] = milliseconds;
+			}
+			next = (next + 1) % length;
+		}
+	};
+
+	// Every event of one frame, start and end relative to the start of its frame zone
+	struct Timeline {
+		std::uint64_t frame = 0;
+		std::int64_t frameLength = 0;
+		std::int64_t length = 0;		// Until the last event ended, can run past the frame
+		std::vector<ProfileEvent> events;
+	};
+
+	// Zones in the order they were first seen, there are only a handful so a linear search is enough
+	ZoneHistory& history(const char* zone) {
+		for (auto& entry : zones) {
+			if (entry.first == zone) {
+				return entry.second;
+			}
+		}
+		zones.emplace_back(zone, ZoneHistory());
+		return zones.back().second;
+	}
+
+	float percentile(float fraction) const {
+		return sorted[static_cast<std::size_t>(fraction * (sorted.size() - 1) + 0.5f)];
+	}
+
+	void completeFrame(std::uint64_t frame) {
+		auto found = pending.find(frame);
+		if (found != pending.end()) {
+			Timeline timeline;
+			timeline.frame = frame;
+			timeline.events = std::move(found->second);
+
+			std::int64_t origin = timeline.events.front().start;
+			for (const ProfileEvent& event : timeline.events) {
+				if (event.zone == frameZoneName) {
+					origin = event.start;
+					timeline.frameLength = event.end - event.start;
+				}
+			}
+			for (ProfileEvent& event : timeline.events) {
+				event.start -= origin;
+				event.end -= origin;
+				timeline.length = std::max(timeline.length, event.end);
+			}
+
+			if (holdSlowest && timeline.frameLength > slowest.frameLength) {
+				slowest = timeline;
+			}
+			latest = std::move(timeline);
+		}
+		pending.erase(pending.begin(), pending.upper_bound(frame));
+	}
+
+	static ImU32 zoneColour(const char* zone) {
+		const std::size_t hash = std::hash<const char*>()(zone);
+		return ImColor::HSV(static_cast<float>(hash % 997) / 997.0f, 0.5f, 0.75f);
+	}
 
-	Shape() {}
-	virtual ~Shape() {}
-};
+	void drawTimeline(const Timeline& timeline) {
+		// Each thread gets as many rows as it nests zones deep
+		std::vector<std::uint32_t> rowsPerThread;
+		for (const ProfileEvent& event : timeline.events) {
+			if (event.thread >= rowsPerThread.size()) {
+				rowsPerThread.resize(event.thread + 1, 0);
+			}
+			rowsPerThread[event.thread] = std::max(rowsPerThread[event.thread], event.depth + 1);
+		}
+		std::vector<std::uint32_t> firstRow(rowsPerThread.size() + 1, 0);
+		for (std::size_t thread = 0; thread < rowsPerThread.size(); ++thread) {
+			firstRow[thread + 1] = firstRow[thread] + rowsPerThread[thread];
+		}
 
-class Circle : public Shape {
-public:
-	float radius;
-	float segments = 64.0f;
-	sf::CircleShape circle;
+		const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+		const ImVec2 origin = ImGui::GetCursorScreenPos();
+		const float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+		ImGui::InvisibleButton("##ProfilerTimeline", ImVec2(width, std::max(firstRow.back() * rowHeight, 1.0f)));
+		const bool hovered = ImGui::IsItemHovered();
+		const ImVec2 mouse = ImGui::GetMousePos();
+
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		const float scale = width / std::max<std::int64_t>(timeline.length, 1);
+		for (const ProfileEvent& event : timeline.events) {
+			const ImVec2 min(origin.x + event.start * scale, origin.y + (firstRow[event.thread] + event.depth) * rowHeight);
+			const ImVec2 max(std::max(origin.x + event.end * scale, min.x + 1.0f), min.y + rowHeight - 1.0f);
+			drawList->AddRectFilled(min, max, zoneColour(event.zone));
+
+			drawList->PushClipRect(min, max, true);
+			drawList->AddText(ImVec2(min.x + 2.0f, min.y + 2.0f), IM_COL32(255, 255, 255, 255), event.zone);
+			drawList->PopClipRect();
 
-	void print() {
-		std::cout << "Circle created: "
-			<< name << " "
-			<< posX << " " << posY << " "
-			<< speedX << " " << speedY << " "
-			<< r << " " << g << " " << b << " "
-			<< radius
-			<< std::endl;
+			if (hovered && mouse.x >= min.x && mouse.x < max.x && mouse.y >= min.y && mouse.y < max.y) {
+				ImGui::SetTooltip("%s: %.3f ms, thread %u", event.zone, (event.end - event.start) * 1e-6f, event.thread);
+			}
+		}
 	}
+
+	std::uint64_t nextEvent = 0;
+	std::vector<ProfileEvent> incoming;
+	std::vector<std::pair<const char*, ZoneHistory>> zones;
+	std::vector<float> sorted;
+	std::map<std::uint64_t, std::vector<ProfileEvent>> pending;	// Events by frame, until the frame is complete
+	Timeline latest;
+	Timeline slowest;
+	bool frozen = false;
+	bool holdSlowest = false;
 };
 
-class Rectangle : public Shape {
-public:
-	float width, height;
-	sf::RectangleShape rectangle;
+// Adds the profiler to the Debug Panel window, between NewFrame and Render
+void BuildProfilerPanel(ProfilerView& view) {
+	view.update();
 
-	void print() {
-		std::cout << "Rectangle created: "
-			<< name << " "
-			<< posX << " " << posY << " "
-			<< speedX << " " << speedY << " "
-			<< r << " " << g << " " << b << " "
-			<< width << " " << height
-			<< std::endl;
+	ImGui::Begin("Debug Panel");
+	if (ImGui::CollapsingHeader("Profiler")) {
+		view.build();
 	}
-};
+	ImGui::End();
+}
 
 // --------------------------------------------------------------------------
 
-// Structures & class for configuration
-struct WindowConfig {
-	int width;
-	int height;
-};
+// Command line options
+struct Options {
+	std::string configurationPath = "config.txt";
+	bool benchmark = false;
+	bool headless = false;
+	bool stream = false;				// Open the window after the first batch and keep loading while drawing
+	bool collisions = true;				// Shapes bounce off each other as well as off the window edges
+	LoadVerbosity loadVerbosity = LoadVerbosity::Summary;
+	long long ticks = 600;
+	float dt = 1.0f / speedTickRate;	// Length of a simulation tick, in the window as well as headless
+	unsigned int frameLimit = 60;		// Frames drawn per second at most, 0 follows the monitor with vsync
 
-struct FontConfig {
-	std::string path;
-	int size;
-	int r, g, b;
-};
+	std::string compileScenePath;		// Compile the configuration into this scene file and exit
 
-struct Configuration {
-	WindowConfig window;
-	FontConfig font;
-	std::vector<std::shared_ptr<Shape>> shapes;
+	std::string benchmarkFilter;		// Only benchmarks whose name contains this run
+	std::string benchmarkJsonPath;		// Where to write the results as JSON, nowhere when empty
+	std::size_t benchmarkMaxLines = 1000000;
 };
 
+void PrintUsage() {
+	std::cout << "Usage: assignment-one [--config <path>] [--stream] [--load-report quiet|summary|shapes] [--compile-scene <path>] [--benchmark [--benchmark-filter <text>] [--benchmark-json <path>] [--benchmark-max-lines <n>]] [--headless [--ticks <n>]] [--dt <seconds> | --tick-rate <hz>] [--frame-limit <fps>] [--no-collisions]" << std::endl;
+}
+
+// Returns false when the arguments are invalid
+bool ParseOptions(int argc, char* argv[], Options& options) {
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--benchmark") {
+			options.benchmark = true;
+		}
+		else if (arg == "--headless") {
+			options.headless = true;
+		}
+		else if (arg == "--stream") {
+			options.stream = true;
+		}
+		else if (arg == "--no-collisions") {
+			options.collisions = false;
+		}
+		else if (arg == "--config" && hasValue) {
+			options.configurationPath = argv[++i];
+		}
+		else if (arg == "--load-report" && hasValue) {
+			const std::string level = argv[++i];
+			if (level == "quiet") {
+				options.loadVerbosity = LoadVerbosity::Quiet;
+			}
+			else if (level == "summary") {
+				options.loadVerbosity = LoadVerbosity::Summary;
+			}
+			else if (level == "shapes") {
+				options.loadVerbosity = LoadVerbosity::Shapes;
+			}
+			else {
+				std::cerr << "Error: --load-report must be quiet, summary or shapes." << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--compile-scene" && hasValue) {
+			options.compileScenePath = argv[++i];
+		}
+		else if (arg == "--benchmark-filter" && hasValue) {
+			options.benchmarkFilter = argv[++i];
+		}
+		else if (arg == "--benchmark-json" && hasValue) {
+			options.benchmarkJsonPath = argv[++i];
+		}
+		else if (arg == "--benchmark-max-lines" && hasValue) {
+			options.benchmarkMaxLines = static_cast<std::size_t>(std::atoll(argv[++i]));
+		}
+		else if (arg == "--ticks" && hasValue) {
+			options.ticks = std::atoll(argv[++i]);
+		}
+		else if (arg == "--dt" && hasValue) {
+			options.dt = static_cast<float>(std::atof(argv[++i]));
+		}
+		else if (arg == "--tick-rate" && hasValue) {
+			options.dt = 1.0f / static_cast<float>(std::atof(argv[++i]));
+		}
+		else if (arg == "--frame-limit" && hasValue) {
+			options.frameLimit = static_cast<unsigned int>(std::atoi(argv[++i]));
+		}
+		else {
+			std::cerr << "Error: Unknown or incomplete argument " << arg << std::endl;
+			return false;
+		}
+	}
+
+	if (options.ticks < 0 || !(options.dt > 0.0f) || std::isinf(options.dt)) {
+		std::cerr << "Error: --ticks must not be negative and --dt and --tick-rate must be positive." << std::endl;
+		return false;
+	}
+	return true;
+}
+
 // --------------------------------------------------------------------------
 
-Configuration LoadConfiguration(std::string& configurationPath) {
-	std::ifstream file(configurationPath);
-	std::string line;
+// Benchmarks, run with --benchmark instead of opening a window
 
-	if (!file.is_open()) {
-		std::cerr << "Error: Unable to open file." << std::endl;
-		exit(-1);
+// Fills a store with randomly placed shapes inside the given bounds, half circles and half rectangles
+ShapeStore MakeRandomShapes(std::size_t count, float boundsX, float boundsY, unsigned int seed = 1) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> size(2.0f, 20.0f);
+	std::uniform_real_distribution<float> speed(-5.0f, 5.0f);
+	std::uniform_real_distribution<float> colour(0.0f, 255.0f);
+
+	ShapeStore shapes;
+	shapes.reserve(count);
+	for (std::size_t i = 0; i < count; ++i) {
+		float w = size(rng), h = size(rng);
+		float x = std::uniform_real_distribution<float>(0.0f, boundsX - w)(rng);
+		float y = std::uniform_real_distribution<float>(0.0f, boundsY - h)(rng);
+		const std::string name = (i % 2 == 0 ? "C" : "R") + std::to_string(i);
+
+		if (i % 2 == 0) {
+			shapes.addCircle(name, x, y, speed(rng), speed(rng), colour(rng), colour(rng), colour(rng), w * 0.5f);
+		}
+		else {
+			shapes.addRectangle(name, x, y, speed(rng), speed(rng), colour(rng), colour(rng), colour(rng), w, h);
+		}
 	}
+	return shapes;
+}
 
-	Configuration config;
+// The shared_ptr/dynamic_pointer_cast layout the ShapeStore replaced, kept only as a benchmark baseline
+namespace legacy {
+	class Shape {
+	public:
+		float posX, posY;
+		float speedX, speedY;
+		bool shapeDrawn = true;
+		virtual ~Shape() {}
+	};
 
-	while (std::getline(file, line)) {
-		std::istringstream iss(line);
-		std::string dataType;
-		iss >> dataType;
+	class Circle : public Shape {
+	public:
+		float radius;
+	};
 
-		if (dataType == "Circle") {
-			Circle circle;
+	class Rectangle : public Shape {
+	public:
+		float width, height;
+	};
 
-			iss >> circle.name >> circle.posX >> circle.posY >> circle.speedX >> circle.speedY
-				>> circle.r >> circle.g >> circle.b >> circle.radius;
+	void UpdatePosition(const std::shared_ptr<Shape> shape, float boundsX, float boundsY) {
+		shape->posX += shape->speedX;
+		shape->posY += shape->speedY;
 
-			circle.print();
-			config.shapes.push_back(std::make_shared<Circle>(circle)); // Adds shape to shapes vector
+		float right, bottom;
+		if (auto circle = std::dynamic_pointer_cast<Circle>(shape)) {
+			right = circle->posX + (circle->radius * 2);
+			bottom = circle->posY + (circle->radius * 2);
+		}
+		else if (auto rectangle = std::dynamic_pointer_cast<Rectangle>(shape)) {
+			right = rectangle->posX + rectangle->width;
+			bottom = rectangle->posY + rectangle->height;
+		}
+		else {
+			return;
 		}
-		else if (dataType == "Rectangle") {
-			Rectangle rectangle;
 
-			iss >> rectangle.name >> rectangle.posX >> rectangle.posY >> rectangle.speedX >> rectangle.speedY
-				>> rectangle.r >> rectangle.g >> rectangle.b >> rectangle.width >> rectangle.height;
+		if (shape->posX < 0 || right > boundsX) {
+			shape->speedX *= -1;
+		}
+		if (shape->posY < 0 || bottom > boundsY) {
+			shape->speedY *= -1;
+		}
+	}
 
-			rectangle.print();
-			config.shapes.push_back(std::make_shared<Rectangle>(rectangle)); // Adds shape to shapes vector
+	std::vector<std::shared_ptr<Shape>> FromStore(const ShapeStore& store) {
+		std::vector<std::shared_ptr<Shape>> shapes;
+		shapes.reserve(store.size());
+		for (std::size_t i = 0; i < store.size(); ++i) {
+			std::shared_ptr<Shape> shape;
+			if (store.kinds[i] == ShapeKind::Circle) {
+				auto circle = std::make_shared<Circle>();
+				circle->radius = store.radius(i);
+				shape = circle;
+			}
+			else {
+				auto rectangle = std::make_shared<Rectangle>();
+				rectangle->width = store.width[i];
+				rectangle->height = store.height[i];
+				shape = rectangle;
+			}
+			shape->posX = store.posX[i];
+			shape->posY = store.posY[i];
+			shape->speedX = store.speedX[i];
+			shape->speedY = store.speedY[i];
+			shapes.push_back(shape);
 		}
-		else if (dataType == "Font") {
-			iss >> config.font.path >> config.font.size >> config.font.r >> config.font.g >> config.font.b;
+		return shapes;
+	}
+}
+
+// Result of one benchmark, nanoseconds are per iteration of the benchmarked function
+struct BenchmarkResult {
+	std::string name;
+	std::size_t itemsPerIteration;
+	long long iterations;
+	double nsPerIteration;
+};
+
+// Runs named benchmarks, prints a row for each and optionally writes them all as JSON in the same
+// spirit as Google Benchmark's output, so runs can be compared by scripts
+class BenchmarkSuite {
+public:
+	explicit BenchmarkSuite(const std::string& filter) : filter(filter) {
+		std::printf("%-44s %12s %16s %12s\n", "benchmark", "iterations", "ns/iteration", "ns/item");
+	}
+
+	bool enabled(const std::string& name) const {
+		return filter.empty() || name.find(filter) != std::string::npos;
+	}
+
+	// Runs fn repeatedly for at least a quarter of a second. A first call that already takes longer
+	// than that is reported on its own, otherwise it only warms up caches and the allocator
+	template <typename Function>
+	void run(const std::string& name, std::size_t itemsPerIteration, Function fn) {
+		if (!enabled(name)) {
+			return;
 		}
-		else if (dataType == "Window") {
-			iss >> config.window.width >> config.window.height;
+
+		using Clock = std::chrono::steady_clock;
+		const auto minimumTime = std::chrono::milliseconds(250);
+
+		long long iterations = 1;
+		auto start = Clock::now();
+		fn();
+		auto elapsed = Clock::now() - start;
+
+		if (elapsed < minimumTime) {
+			iterations = 0;
+			start = Clock::now();
+			do {
+				fn();
+				++iterations;
+				elapsed = Clock::now() - start;
+			} while (elapsed < minimumTime);
 		}
+
+		const double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+		results.push_back({ name, itemsPerIteration, iterations, ns });
+		std::printf("%-44s %12lld %16.1f %12.3f\n", name.c_str(), iterations, ns, ns / std::max<std::size_t>(itemsPerIteration, 1));
+		std::fflush(stdout);
 	}
 
-	return config;
+	bool writeJson(const std::string& path) const {
+		std::ofstream file(path);
+		if (!file.is_open()) {
+			std::cerr << "Error: Unable to write benchmark results to " << path << "." << std::endl;
+			return false;
+		}
+
+		file << std::fixed << std::setprecision(3);
+		file << "{\n  \"context\": {\n"
+			<< "    \"threads\": " << std::max(1u, std::thread::hardware_concurrency()) << ",\n"
+			<< "    \"kinematics_kernel\": \"" << SelectedKinematicsKernel().name << "\"\n"
+			<< "  },\n  \"benchmarks\": [\n";
+		for (std::size_t i = 0; i < results.size(); ++i) {
+			const BenchmarkResult& result = results[i];
+			file << "    { \"name\": \"" << result.name << "\""
+				<< ", \"iterations\": " << result.iterations
+				<< ", \"items_per_iteration\": " << result.itemsPerIteration
+				<< ", \"real_time_ns\": " << result.nsPerIteration
+				<< ", \"ns_per_item\": " << result.nsPerIteration / std::max<std::size_t>(result.itemsPerIteration, 1)
+				<< " }" << (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		file << "  ]\n}\n";
+		return true;
+	}
+
+private:
+	std::string filter;
+	std::vector<BenchmarkResult> results;
+};
+
+// Writes a configuration with a Window and Font line followed by shape lines, lineCount lines in total
+void WriteSyntheticConfiguration(const std::string& path, std::size_t lineCount) {
+	std::ofstream file(path);
+	file << "Window 1280 720\n";
+	file << "Font fonts/tech.ttf 18 255 255 255\n";
+
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int> coordinate(0, 600), speed(-5, 5), colour(0, 255), size(2, 40);
+	for (std::size_t i = 2; i < lineCount; ++i) {
+		if (i % 2 == 0) {
+			file << "Circle C" << i << ' ' << coordinate(rng) << ' ' << coordinate(rng) << ' ' << speed(rng) << ' ' << speed(rng)
+				<< ' ' << colour(rng) << ' ' << colour(rng) << ' ' << colour(rng) << ' ' << size(rng) << '\n';
+		}
+		else {
+			file << "Rectangle R" << i << ' ' << coordinate(rng) << ' ' << coordinate(rng) << ' ' << speed(rng) << ' ' << speed(rng)
+				<< ' ' << colour(rng) << ' ' << colour(rng) << ' ' << colour(rng) << ' ' << size(rng) << ' ' << size(rng) << '\n';
+		}
+	}
 }
 
-void UpdatePosition(const std::shared_ptr<Shape> shape, const sf::RenderWindow& window) {
-	// Update position
-	shape->posX += shape->speedX;
-	shape->posY += shape->speedY;
+void BenchmarkDispatch(BenchmarkSuite& suite) {
+	const float boundsX = 1280.0f, boundsY = 720.0f;
 
-	// Check for collision with the window boundaries and reverse the direction of the respective axis
-	if (auto circle = std::dynamic_pointer_cast<Circle>(shape)) {
-		float left = circle->posX  ;
-		float right = circle->posX + (circle->radius * 2);
-		float top = circle->posY ;
-		float bottom = circle->posY + (circle->radius * 2);
+	for (std::size_t count : { 10000u, 100000u, 1000000u }) {
+		ShapeStore store = MakeRandomShapes(count, boundsX, boundsY);
+		auto legacyShapes = legacy::FromStore(store);
 
+		// The legacy draw loop cast once more per shape to find its kind
+		volatile float sink = 0.0f;
+		suite.run("dispatch/legacy/" + std::to_string(count), count, [&]() {
+			float sum = 0.0f;
+			for (const auto& shape : legacyShapes) {
+				if (shape->shapeDrawn) {
+					legacy::UpdatePosition(shape, boundsX, boundsY);
+					if (auto circle = std::dynamic_pointer_cast<legacy::Circle>(shape)) {
+						sum += circle->radius;
+					}
+					else if (auto rectangle = std::dynamic_pointer_cast<legacy::Rectangle>(shape)) {
+						sum += rectangle->width;
+					}
+				}
+			}
+			sink = sum;
+		});
 
-		if (left < 0 || right > window.getSize().x) {
-			shape->speedX *= -1;
+		JobSystem serial(1);
+		suite.run("dispatch/store/" + std::to_string(count), count, [&]() {
+			UpdatePositions(store, sf::Vector2u(static_cast<unsigned int>(boundsX), static_cast<unsigned int>(boundsY)), serial);
+			float sum = 0.0f;
+			for (std::uint32_t i : store.circles) {
+				sum += store.width[i];
+			}
+			for (std::uint32_t i : store.rectangles) {
+				sum += store.width[i];
+			}
+			sink = sum;
+		});
+	}
+}
+
+void BenchmarkKinematics(BenchmarkSuite& suite) {
+	const float boundsX = 1280.0f, boundsY = 720.0f;
+
+	for (std::size_t count : { 10000u, 100000u, 1000000u }) {
+		for (const auto& info : AvailableKinematicsKernels()) {
+			ShapeStore store = MakeRandomShapes(count, boundsX, boundsY);
+			const KinematicsArrays arrays = GetKinematicsArrays(store);
+
+			suite.run(std::string("kinematics/") + info.name + "/" + std::to_string(count), count, [&]() {
+				info.kernel(arrays, boundsX, boundsY, 1.0f);
+			});
 		}
-		if (top < 0 || bottom > window.getSize().y) {
-			shape->speedY *= -1;
+	}
+}
+
+// The full parallel update pass at varying shape counts, then at a fixed count with varying thread counts
+void BenchmarkUpdate(BenchmarkSuite& suite, JobSystem& jobs) {
+	const sf::Vector2u bounds(1280, 720);
+
+	for (std::size_t count : { 1000u, 10000u, 100000u, 1000000u }) {
+		ShapeStore store = MakeRandomShapes(count, static_cast<float>(bounds.x), static_cast<float>(bounds.y));
+		suite.run("update/" + std::to_string(count), count, [&]() {
+			UpdatePositions(store, bounds, jobs);
+		});
+	}
+
+	const std::size_t count = 1000000;
+	for (unsigned int threads = 1; threads <= jobs.threadCount(); threads *= 2) {
+		const std::string name = "update/threads:" + std::to_string(threads) + "/" + std::to_string(count);
+		if (!suite.enabled(name)) {
+			continue;
 		}
+
+		JobSystem scaled(threads);
+		ShapeStore store = MakeRandomShapes(count, static_cast<float>(bounds.x), static_cast<float>(bounds.y));
+		suite.run(name, count, [&]() {
+			UpdatePositions(store, bounds, scaled);
+		});
 	}
-	else if (auto rectangle = std::dynamic_pointer_cast<Rectangle>(shape)) {
-		float left = rectangle->posX;
-		float right = rectangle->posX + rectangle->width;
-		float top = rectangle->posY;
-		float bottom = rectangle->posY + rectangle->height;
+}
 
-		if (left < 0 || right > window.getSize().x) {
-			shape->speedX *= -1;
+// One tick of shape-to-shape collisions, grid build included. The bounds grow with the count so about a
+// quarter of the area is covered and every scene is equally crowded
+void BenchmarkCollisions(BenchmarkSuite& suite, JobSystem& jobs) {
+	for (std::size_t count : { 1000u, 10000u, 100000u }) {
+		const float boundsX = std::sqrt(count * 500.0f * 16.0f / 9.0f);
+		const sf::Vector2u bounds(static_cast<unsigned int>(boundsX), static_cast<unsigned int>(boundsX * 9.0f / 16.0f));
+		ShapeStore store = MakeRandomShapes(count, static_cast<float>(bounds.x), static_cast<float>(bounds.y));
+		CollisionSystem collisions;
+
+		suite.run("collisions/" + std::to_string(count), count, [&]() {
+			UpdatePositions(store, bounds, jobs);
+			collisions.step(store, bounds, jobs);
+		});
+	}
+
+	const std::size_t count = 100000;
+	const float boundsX = std::sqrt(count * 500.0f * 16.0f / 9.0f);
+	const sf::Vector2u bounds(static_cast<unsigned int>(boundsX), static_cast<unsigned int>(boundsX * 9.0f / 16.0f));
+	for (unsigned int threads = 1; threads <= jobs.threadCount(); threads *= 2) {
+		const std::string name = "collisions/threads:" + std::to_string(threads) + "/" + std::to_string(count);
+		if (!suite.enabled(name)) {
+			continue;
 		}
-		if (top < 0 || bottom > window.getSize().y) {
-			shape->speedY *= -1;
+
+		JobSystem scaled(threads);
+		ShapeStore store = MakeRandomShapes(count, static_cast<float>(bounds.x), static_cast<float>(bounds.y));
+		CollisionSystem collisions;
+		suite.run(name, count, [&]() {
+			UpdatePositions(store, bounds, scaled);
+			collisions.step(store, bounds, scaled);
+		});
+	}
+}
+
+// Keeping the spatial index in line after a tick of movement, and picking shapes through it
+void BenchmarkSpatialIndex(BenchmarkSuite& suite, JobSystem& jobs) {
+	const sf::Vector2u bounds(1280, 720);
+
+	for (std::size_t count : { 10000u, 100000u, 1000000u }) {
+		ShapeStore store = MakeRandomShapes(count, static_cast<float>(bounds.x), static_cast<float>(bounds.y));
+		SpatialIndex index;
+		index.update(store, store.posX.data(), store.posY.data(), static_cast<float>(bounds.x), static_cast<float>(bounds.y), jobs);
+
+		suite.run("spatial_index/update/" + std::to_string(count), count, [&]() {
+			UpdatePositions(store, bounds, jobs);
+			index.update(store, store.posX.data(), store.posY.data(), static_cast<float>(bounds.x), static_cast<float>(bounds.y), jobs);
+		});
+
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> pointX(0.0f, static_cast<float>(bounds.x)), pointY(0.0f, static_cast<float>(bounds.y));
+		volatile std::size_t sink = 0;
+		suite.run("spatial_index/pick/" + std::to_string(count), 1, [&]() {
+			sink = index.pick(store, store.posX.data(), store.posY.data(), pointX(rng), pointY(rng));
+		});
+	}
+}
+
+// Per-frame cost of turning the store into vertices, in the steady state and with every shape dirty
+void BenchmarkRenderPrep(BenchmarkSuite& suite, JobSystem& jobs) {
+	for (std::size_t count : { 1000u, 10000u, 100000u }) {
+		ShapeStore store = MakeRandomShapes(count, 1280.0f, 720.0f);
+		ShapeBatchRenderer renderer;
+
+		suite.run("render_prep/steady/" + std::to_string(count), count, [&]() {
+			renderer.build(store, jobs);
+		});
+		suite.run("render_prep/all_dirty/" + std::to_string(count), count, [&]() {
+			for (std::size_t i = 0; i < store.size(); ++i) {
+				store.markDirty(i);
+			}
+			renderer.build(store, jobs);
+		});
+	}
+
+	// A window's worth of a world 16 times its area, culled through the spatial index first
+	for (std::size_t count : { 100000u, 1000000u }) {
+		const float worldX = 1280.0f * 4, worldY = 720.0f * 4;
+		ShapeStore store = MakeRandomShapes(count, worldX, worldY);
+		ShapeBatchRenderer renderer;
+		SpatialIndex index;
+		index.update(store, store.posX.data(), store.posY.data(), worldX, worldY, jobs);
+
+		std::vector<std::uint8_t> marks;
+		std::vector<std::uint32_t> visible;
+		const FramePositions positions = CurrentPositions(store);
+		suite.run("render_prep/culled/" + std::to_string(count), count, [&]() {
+			CollectVisibleShapes(index, store, store.posX.data(), store.posY.data(), sf::FloatRect(worldX * 0.375f, worldY * 0.375f, 1280.0f, 720.0f), marks, visible);
+			renderer.build(store, jobs, positions, visible);
+		});
+		suite.run("render_prep/unculled/" + std::to_string(count), count, [&]() {
+			renderer.build(store, jobs, positions);
+		});
+	}
+
+	// Tessellated circles at their own segment count and with the level of detail chosen for a view zoomed
+	// out to an eighth
+	for (std::size_t count : { 10000u, 100000u }) {
+		ShapeStore store = MakeRandomShapes(count, 1280.0f * 8, 720.0f * 8);
+		ShapeBatchRenderer renderer;
+
+		renderer.setCircleLod(false);
+		suite.run("render_prep/lod_off/" + std::to_string(count), count, [&]() {
+			renderer.build(store, jobs);
+		});
+		renderer.setCircleLod(true);
+		renderer.setPixelsPerUnit(0.125f);
+		suite.run("render_prep/lod_zoomed_out/" + std::to_string(count), count, [&]() {
+			renderer.build(store, jobs);
+		});
+	}
+}
+
+// Builds the Debug Panel in a window-less ImGui context, with the shape list showing its first rows
+void BenchmarkDebugPanel(BenchmarkSuite& suite) {
+	ImGui::CreateContext();
+	ImGuiIO& io = ImGui::GetIO();
+	io.DisplaySize = ImVec2(1280.0f, 720.0f);
+	io.DeltaTime = 1.0f / 60.0f;
+	io.IniFilename = nullptr;
+	io.Fonts->Build();
+
+	for (std::size_t count : { 10u, 1000u, 100000u, 1000000u }) {
+		ShapeStore store = MakeRandomShapes(count, 1280.0f, 720.0f);
+		DebugPanelState panel = CreateDebugPanelState(store);
+		ShapeBatchRenderer renderer;
+		CollisionSystem collisions;
+
+		suite.run("imgui/debug_panel/" + std::to_string(count), 1, [&]() {
+			ImGui::NewFrame();
+			BuildDebugPanel(panel, store, renderer, collisions);
+			ImGui::Render();
+		});
+
+		// The same with the list filtered to the names starting with "C1"
+		std::strcpy(panel.search, "C1");
+		suite.run("imgui/debug_panel/search/" + std::to_string(count), 1, [&]() {
+			ImGui::NewFrame();
+			BuildDebugPanel(panel, store, renderer, collisions);
+			ImGui::Render();
+		});
+	}
+
+	ImGui::DestroyContext();
+}
+
+void BenchmarkLoadConfiguration(BenchmarkSuite& suite, JobSystem& jobs, std::size_t maxLines) {
+	for (std::size_t lines = 1000; lines <= maxLines; lines *= 10) {
+		const std::string name = "load_config/" + std::to_string(lines);
+		if (!suite.enabled(name)) {
+			continue;
+		}
+
+		const std::string path = "benchmark-config-" + std::to_string(lines) + ".txt";
+		WriteSyntheticConfiguration(path, lines);
+
+		suite.run(name, lines, [&]() {
+			Configuration config = LoadConfiguration(path, jobs);
+		});
+
+		// The same scene compiled to the binary format
+		const std::string scenePath = "benchmark-scene-" + std::to_string(lines) + ".scene";
+		CompileScene(LoadConfiguration(path, jobs), scenePath);
+		suite.run("load_scene/" + std::to_string(lines), lines, [&]() {
+			Configuration config = LoadConfiguration(scenePath, jobs);
+		});
+
+		std::remove(path.c_str());
+		std::remove(scenePath.c_str());
+	}
+}
+
+int RunBenchmarks(const Options& options) {
+	BenchmarkSuite suite(options.benchmarkFilter);
+	JobSystem jobs;
+
+	BenchmarkDispatch(suite);
+	BenchmarkKinematics(suite);
+	BenchmarkUpdate(suite, jobs);
+	BenchmarkCollisions(suite, jobs);
+	BenchmarkSpatialIndex(suite, jobs);
+	BenchmarkRenderPrep(suite, jobs);
+	BenchmarkDebugPanel(suite);
+	BenchmarkLoadConfiguration(suite, jobs, options.benchmarkMaxLines);
+
+	if (!options.benchmarkJsonPath.empty() && !suite.writeJson(options.benchmarkJsonPath)) {
+		return 1;
+	}
+	return 0;
+}
+
+// --------------------------------------------------------------------------
+
+// Steps the simulation without a window or ImGui, with the bounds taken from the World line of the
+// configuration or the Window line without one, then reports the timings and the final state of the shapes
+int RunHeadless(const Options& options) {
+	using Clock = std::chrono::steady_clock;
+
+	JobSystem jobs;
+
+	LoadReport loadReport;
+	auto config = LoadConfiguration(options.configurationPath, jobs, &loadReport, options.loadVerbosity);
+	PrintLoadReport(loadReport, config.shapes, options.loadVerbosity);
+	ShapeStore& shapes = config.shapes;
+	const sf::Vector2u bounds = WorldSize(config);
+
+	CollisionSystem collisions;
+	collisions.enabled = options.collisions;
+
+	auto simulateStart = Clock::now();
+	for (long long tick = 0; tick < options.ticks; ++tick) {
+		UpdatePositions(shapes, bounds, jobs, options.dt);
+		collisions.step(shapes, bounds, jobs);
+	}
+	const double simulateMs = std::chrono::duration<double, std::milli>(Clock::now() - simulateStart).count();
+
+	const double shapeTicks = static_cast<double>(shapes.size()) * static_cast<double>(options.ticks);
+	std::printf("Headless run: %zu shapes, %lld ticks of %.6f s, bounds %ux%u, %u threads, %s kernel, collisions %s\n",
+		shapes.size(), options.ticks, options.dt, bounds.x, bounds.y, jobs.threadCount(), SelectedKinematicsKernel().name, options.collisions ? "on" : "off");
+	std::printf("Load:     %.3f ms\n", loadReport.totalMs);
+	std::printf("Simulate: %.3f ms total, %.4f ms/tick, %.3f ns/shape-tick\n", simulateMs,
+		options.ticks > 0 ? simulateMs / options.ticks : 0.0, shapeTicks > 0 ? simulateMs * 1e6 / shapeTicks : 0.0);
+
+	// The sums give a quick fingerprint to compare runs against each other
+	double sumX = 0.0, sumY = 0.0;
+	for (std::size_t i = 0; i < shapes.size(); ++i) {
+		sumX += shapes.posX[i];
+		sumY += shapes.posY[i];
+	}
+	std::printf("Final state: position sum %.6f %.6f\n", sumX, sumY);
+
+	// Small scenes get every shape listed, in the same order as the configuration
+	if (shapes.size() <= 100) {
+		for (std::size_t i = 0; i < shapes.size(); ++i) {
+			std::printf("  %s %.4f %.4f %.4f %.4f\n", shapes.nameCStr(i), shapes.posX[i], shapes.posY[i], shapes.speedX[i], shapes.speedY[i]);
 		}
 	}
+	return 0;
 }
 
 int main(int argc, char* argv[]) {
-	std::string configurationPath = "config.txt";
-	auto config = LoadConfiguration(configurationPath);
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage();
+		return 1;
+	}
+
+	if (options.benchmark) {
+		return RunBenchmarks(options);
+	}
+	if (!options.compileScenePath.empty()) {
+		JobSystem jobs;
+		LoadReport loadReport;
+		auto config = LoadConfiguration(options.configurationPath, jobs, &loadReport, options.loadVerbosity);
+		PrintLoadReport(loadReport, config.shapes, options.loadVerbosity);
+		if (!CompileScene(config, options.compileScenePath)) {
+			std::cerr << "Error: Unable to write " << options.compileScenePath << "." << std::endl;
+			return 1;
+		}
+		std::cout << "Compiled " << config.shapes.size() << " shapes into " << options.compileScenePath << std::endl;
+		return 0;
+	}
+	if (options.headless) {
+		return RunHeadless(options);
+	}
+
+	// Worker threads for loading and the per-shape passes
+	JobSystem jobs;
+
+	// When streaming, the window opens as soon as the first batch of the file is parsed and the rest of
+	// the shapes join the scene as they arrive
+	Configuration config;
+	std::unique_ptr<StreamingLoader> streamingLoader;
+	if (options.stream) {
+		streamingLoader.reset(new StreamingLoader(options.configurationPath, options.loadVerbosity));
+		streamingLoader->receiveFirst(config);
+	}
+	else {
+		LoadReport loadReport;
+		config = LoadConfiguration(options.configurationPath, jobs, &loadReport, options.loadVerbosity);
+		PrintLoadReport(loadReport, config.shapes, options.loadVerbosity);
+	}
+	ShapeStore& shapes = config.shapes;
 
 	sf::RenderWindow window(sf::VideoMode(config.window.width, config.window.height), "2D SFML Shape Renderer");
-	window.setFramerateLimit(60);
+	// The simulation runs at its own fixed rate, so the frame rate can be capped or follow the monitor
+	if (options.frameLimit > 0) {
+		window.setFramerateLimit(options.frameLimit);
+	}
+	else {
+		window.setVerticalSyncEnabled(true);
+	}
 
 	// Initialise ImGUI and create a clock used for its internal timing
 	ImGui::SFML::Init(window);
@@ -173,145 +4363,176 @@ int main(int argc, char* argv[]) {
 	// The ImGui colour {r,g,b} wheel requires floats from 0-1 rather than integers from 0-255
 	float c[3] = { 0.0f, 1.0f, 1.0f };
 
-	// Create a single string with all shape names separated by '\0'
-	std::string shapeNamesStr;
-	for (const auto& shape : config.shapes) {
-		shapeNamesStr += shape->name + '\0';
-	}
-	shapeNamesStr += '\0'; // Double-null terminate the string
-
-	// Store the index of the selected shape
-	int selectedShapeIndex = 0;
+	// Shape names for the Debug Panel and the index of the selected shape
+	DebugPanelState panel = CreateDebugPanelState(shapes);
 
-	// Create shape objects
-	for (const auto& shape : config.shapes) {
-		if (shape->shapeDrawn) {
-			if (auto circle = std::dynamic_pointer_cast<Circle>(shape)) {
-				circle->circle = sf::CircleShape(circle->radius, circle->segments);
-				circle->circle.setFillColor(sf::Color(circle->r, circle->g, circle->b));
-			}
-			else if (auto rectangle = std::dynamic_pointer_cast<Rectangle>(shape)) {
-				rectangle->rectangle = sf::RectangleShape(sf::Vector2f(rectangle->width, rectangle->height));
-				rectangle->rectangle.setFillColor(sf::Color(rectangle->r, rectangle->g, rectangle->b));
-			}
-		}
-	}
+	// All shapes are drawn through one batch rather than an SFML object per shape. Shapes are drawn as GPU
+	// instances when the driver supports instancing, otherwise circles are shader SDF quads when the GPU
+	// supports shaders and tessellated on the CPU when it does not
+	ShapeBatchRenderer renderer;
+	renderer.setSdfCircles(renderer.loadShader());
+	renderer.setInstancing(renderer.instancingAvailable());
 
+	// Shapes bounce off each other, found through a grid rebuilt every frame
+	CollisionSystem collisions;
+	collisions.enabled = options.collisions;
 
-	// Main game loop
-	while (window.isOpen()) {
-		// Event handling
-		sf::Event event;
-		
-		while (window.pollEvent(event)) {
-			ImGui::SFML::ProcessEvent(event);
+	// The simulation steps in ticks of options.dt whatever the frame rate, on its own thread so the ticks
+	// of one frame run while the previous one is drawn
+	SimulationThread simulation(shapes, collisions, jobs, options.dt);
 
-			if (event.type == sf::Event::Closed) {
-				window.close();
-			}
-		}
+	// Where frame time goes, shown in the Debug Panel
+	ProfilerView profilerView;
 
-		// Start a new ImGui frame
-		ImGui::SFML::Update(window, deltaClock.restart());
+	// The world can be bigger than the window, which shows the part of it the camera looks at
+	sf::Vector2u worldSize = WorldSize(config);
+	Camera camera;
+	camera.reset(window.getSize(), worldSize);
+	window.setView(camera.view());
 
-		// Create a window called "Debug Panel" and use it to display the ImGui widgets
-		ImGui::Begin("Debug Panel");
-		ImGui::Text("Parameters of shapes");
+	// Finds the shape under the mouse when the window is clicked, and the shapes in view to draw, both at
+	// the positions the shapes are drawn at
+	DrawnPositions drawn;
+	SpatialIndex spatialIndex;
+	bool pickPending = false;
+	sf::Vector2f pickPoint;
+	bool culling = true;
+	std::vector<std::uint8_t> visibleMarks;
+	std::vector<std::uint32_t> visibleShapes;
+	std::size_t visibleCount = shapes.size();
 
-		// Use the constructed string in the ImGui::Combo function
-		ImGui::Combo("Shapes", &selectedShapeIndex, shapeNamesStr.c_str());
+	// Main game loop
+	while (window.isOpen()) {
+		Profiler().beginFrame();
+		ProfileScope frameZone(frameZoneName);
 
-		// Display and modify parameters of the selected shape
-		auto selectedShape = config.shapes[selectedShapeIndex];
-		ImGui::Checkbox(("Draw " + selectedShape->name).c_str(), &selectedShape->shapeDrawn);
-		
-		// Check if the selected shape is a Circle
-		if (auto circle = std::dynamic_pointer_cast<Circle>(selectedShape)) {
-			ImGui::SliderFloat("Size##Radius", &circle->radius, 0.0f, 255.0f);
-			ImGui::SliderFloat("Segments##Segments", &circle->segments, 0.0f, 64.0f);
+		// Event handling
+		{
+			ProfileScope zone("Events");
+			sf::Event event;
 
+			while (window.pollEvent(event)) {
+				ImGui::SFML::ProcessEvent(event);
 
-			// Set a custom width for the sliders
-			ImGui::PushItemWidth(237.0f); // Adjust the width as needed
+				if (event.type == sf::Event::Closed) {
+					window.close();
+				}
 
-			ImGui::SliderFloat("##SpeedX", &circle->speedX, -5.0f, 5.0f);
-			ImGui::SameLine();
-			ImGui::SliderFloat("Speed##SpeedY", &circle->speedY, -5.0f, 5.0f);
+				// Pan and zoom, the view is applied once the frame's events are in
+				camera.handleEvent(event, ImGui::GetIO().WantCaptureMouse, ImGui::GetIO().WantCaptureKeyboard);
 
-			// Restore the default item width
-			ImGui::PopItemWidth();
+				// A left click outside the ImGui windows selects the shape under the cursor
+				if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left && !ImGui::GetIO().WantCaptureMouse) {
+					pickPending = true;
+					pickPoint = window.mapPixelToCoords(sf::Vector2i(event.mouseButton.x, event.mouseButton.y));
+				}
+			}
+		}
 
-			// For colour ------------------------------
-			// Set a custom width for the sliders
-			ImGui::PushItemWidth(155.0f); // Adjust the width as needed
+		// Wait for the ticks started last frame, the shapes can be changed until the next ones start
+		{
+			ProfileScope zone("Sync");
+			simulation.sync();
+		}
 
-			ImGui::SliderFloat("##Red", &circle->r, 0.0f, 255.0f);
-			ImGui::SameLine();
-			ImGui::SliderFloat("##Green", &circle->g, 0.0f, 255.0f);
-			ImGui::SameLine();
-			ImGui::SliderFloat("Colour##Blue", &circle->b, 0.0f, 255.0f);
+		// Take in any shapes the streaming loader has parsed since the last frame
+		if (streamingLoader) {
+			ProfileScope zone("Stream");
+			const int windowWidth = config.window.width, windowHeight = config.window.height;
+			streamingLoader->receive(config);
 
-			// Restore the default item width
-			ImGui::PopItemWidth();
+			if (config.window.width != windowWidth || config.window.height != windowHeight) {
+				window.setSize(sf::Vector2u(config.window.width, config.window.height));
+				camera.reset(window.getSize(), WorldSize(config));
+			}
+			if (WorldSize(config) != worldSize) {
+				worldSize = WorldSize(config);
+				camera.setWorldSize(worldSize);
+			}
+			if (streamingLoader->finished()) {
+				PrintLoadReport(streamingLoader->report(), shapes, options.loadVerbosity);
+				streamingLoader.reset();
+			}
 		}
-		// Check if the selected shape is a Rectangle
-		else if (auto rectangle = std::dynamic_pointer_cast<Rectangle>(selectedShape)) {
-			// Set a custom width for the sliders
-			ImGui::PushItemWidth(237.0f); // Adjust the width as needed
 
-			ImGui::SliderFloat("##Width", &rectangle->width, 0.0f, 200.0f);
-			ImGui::SameLine();
-			ImGui::SliderFloat("Size##Height", &rectangle->height, 0.0f, 200.0f);
+		// Start a new ImGui frame
+		const sf::Time frameTime = deltaClock.restart();
+		{
+			ProfileScope zone("ImGui Update");
+			ImGui::SFML::Update(window, frameTime);
+		}
 
-			ImGui::SliderFloat("##SpeedX", &rectangle->speedX, -5.0f, 5.0f);
-			ImGui::SameLine();
-			ImGui::SliderFloat("Speed##SpeedY", &rectangle->speedY, -5.0f, 5.0f);
+		// Create a window called "Debug Panel" and use it to display the ImGui widgets
+		{
+			ProfileScope zone("UI build");
+			BuildDebugPanel(panel, shapes, renderer, collisions);
+			BuildProfilerPanel(profilerView);
+			BuildCameraPanel(camera, culling, visibleCount, shapes.size());
+		}
 
-			// Restore the default item width
-			ImGui::PopItemWidth();
+		camera.update(frameTime.asSeconds(), ImGui::GetIO().WantCaptureKeyboard);
+		window.setView(camera.view());
 
-			// For colour ------------------------------
-			// Set a custom width for the sliders
-			ImGui::PushItemWidth(155.0f); // Adjust the width as needed
+		// Move shapes in as many fixed ticks as fit in the time the last frame took, while this frame draws
+		// where the ticks of the last frame left them
+		{
+			ProfileScope zone("Shape update");
+			simulation.start(frameTime.asSeconds(), worldSize);
+		}
 
-			ImGui::SliderFloat("##Red", &rectangle->r, 0.0f, 255.0f);
-			ImGui::SameLine();
-			ImGui::SliderFloat("##Green", &rectangle->g, 0.0f, 255.0f);
-			ImGui::SameLine();
-			ImGui::SliderFloat("Colour##Blue", &rectangle->b, 0.0f, 255.0f);
+		// A click landed on the last frame, so resolve it against the index while it still holds the
+		// positions that frame was drawn at. Then interpolate this frame's positions, the snapshot holds still
+		// while the simulation runs, and bring the index in line with them
+		{
+			ProfileScope zone("Spatial index");
+			if (pickPending) {
+				const std::size_t picked = spatialIndex.pick(shapes, drawn.x.data(), drawn.y.data(), pickPoint.x, pickPoint.y);
+				if (picked != SpatialIndex::npos) {
+					panel.selectedShapeIndex = static_cast<int>(picked);
+					panel.scrollToSelected = true;
+				}
+				pickPending = false;
+			}
 
-			// Restore the default item width
-			ImGui::PopItemWidth();
+			drawn.update(simulation.snapshot().positions(), shapes.size(), jobs);
+			spatialIndex.update(shapes, drawn.x.data(), drawn.y.data(), static_cast<float>(worldSize.x), static_cast<float>(worldSize.y), jobs);
 		}
 
-		ImGui::End();
+		{
+			ProfileScope zone("Draw");
 
-		// Clear the window
-		window.clear();
+			// Clear the window
+			window.clear();
 
-		// Draw shapes
-		for (const auto& shape : config.shapes) {
-			if (shape->shapeDrawn) {
-				if (auto circle = std::dynamic_pointer_cast<Circle>(shape)) {
-					circle->circle.setRadius(circle->radius);
-					circle->circle.setPointCount(circle->segments);
-					circle->circle.setFillColor(sf::Color(circle->r, circle->g, circle->b));
-					UpdatePosition(shape, window);
-					circle->circle.setPosition(circle->posX, circle->posY);
-					window.draw(circle->circle);
-				}
-				else if (auto rectangle = std::dynamic_pointer_cast<Rectangle>(shape)) {
-					rectangle->rectangle.setSize(sf::Vector2f(rectangle->width, rectangle->height));
-					rectangle->rectangle.setFillColor(sf::Color(rectangle->r, rectangle->b, rectangle->g));
-					UpdatePosition(shape, window);
-					rectangle->rectangle.setPosition(rectangle->posX, rectangle->posY);
-					window.draw(rectangle->rectangle);
+			// Draw shapes, only those in view when the camera shows part of the world, with circles as detailed
+			// as their size on screen needs
+			const FramePositions positions = drawn.positions();
+			renderer.setPixelsPerUnit(1.0f / camera.zoomLevel());
+			if (culling && !camera.showsWholeWorld()) {
+				{
+					ProfileScope zone("Culling");
+					CollectVisibleShapes(spatialIndex, shapes, drawn.x.data(), drawn.y.data(), camera.area(), visibleMarks, visibleShapes);
 				}
+				ProfileScope zone("Vertices");
+				renderer.build(shapes, jobs, positions, visibleShapes);
+				visibleCount = visibleShapes.size();
 			}
+			else {
+				ProfileScope zone("Vertices");
+				renderer.build(shapes, jobs, positions);
+				visibleCount = shapes.size();
+			}
+			ProfileScope drawZone("Draw call");
+			renderer.draw(window);
+		}
+
+		{
+			ProfileScope zone("ImGui Render");
+			ImGui::SFML::Render(window);
 		}
 
-		ImGui::SFML::Render(window);
+		ProfileScope zone("Display");
 		window.display();
 	}
 	ImGui::SFML::Shutdown();
-}
\ No newline at end of file
+}